@@ -64,6 +64,8 @@ defined in linker script */
 .word _ebss
 
 .equ  BootRAM, 0xF108F85F
+/* pattern for stack usage measurement, keep in sync with STACK_PAINT in stackmon.h */
+.equ  StackPaint, 0xDEADBEEF
 /**
  * @brief  This is the code that gets called when the processor first
  *          starts execution following a reset event. Only the absolutely
@@ -78,6 +80,31 @@ defined in linker script */
   .type Reset_Handler, %function
 Reset_Handler:
 
+/* Start the DWT cycle counter from zero, for boot profiling (see boot.h) */
+  ldr r0, =0xE000EDFC   /* CoreDebug->DEMCR */
+  ldr r1, [r0]
+  orr r1, r1, #0x01000000 /* TRCENA */
+  str r1, [r0]
+  ldr r0, =0xE0001000   /* DWT->CTRL */
+  movs r1, #0
+  str r1, [r0, #4]      /* DWT->CYCCNT */
+  ldr r1, [r0]
+  orr r1, r1, #1        /* CYCCNTENA */
+  str r1, [r0]
+
+/* Paint the free RAM between the heap start and the stack pointer */
+  ldr r0, =end
+  ldr r1, =StackPaint
+  mov r2, sp
+  b LoopPaintStack
+
+PaintStack:
+  str r1, [r0], #4
+
+LoopPaintStack:
+  cmp r0, r2
+  bcc PaintStack
+
 /* Copy the data segment initializers from flash to SRAM */
   movs r1, #0
   b LoopCopyDataInit
@@ -44,6 +44,8 @@
 #define LED1_Pin GPIO_PIN_13
 #define LED1_GPIO_Port GPIOC
 /* USER CODE BEGIN Private defines */
+// Pins for User/utils/pin.h - "port letter, pin number"
+#define LED1 C, 13
 
 /* USER CODE END Private defines */
 
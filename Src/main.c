@@ -38,6 +38,7 @@
 /* USER CODE BEGIN Includes */
 #include "handlers.h"
 #include "user_main.h"
+#include "utils/boot.h"
 /* USER CODE END Includes */
 
 /* Private variables ---------------------------------------------------------*/
@@ -64,7 +65,18 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
+  boot_mark("startup");
 
+#if BOOT_FAST
+  // Stay on HSI, get the UART up first. The PLL and GPIO follow
+  // from boot_fast_continue() in user_init().
+  HAL_Init();
+  // MX_GPIO_Init() comes later, but the UART pins need their port clock now
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  MX_USART1_UART_Init();
+  boot_mark("USART");
+  user_main(); // main loop, rest is unreachable.
+#endif
   /* USER CODE END 1 */
 
   /* MCU Configuration----------------------------------------------------------*/
@@ -80,6 +92,7 @@ int main(void)
   MX_USART1_UART_Init();
 
   /* USER CODE BEGIN 2 */
+  boot_mark("USART");
   user_main(); // main loop, rest is unreachable.
   /* USER CODE END 2 */
 
@@ -36,7 +36,7 @@
 
 extern void Error_Handler(void);
 /* USER CODE BEGIN 0 */
-
+#include "utils/boot.h"
 /* USER CODE END 0 */
 
 /**
@@ -73,6 +73,7 @@ void HAL_MspInit(void)
   __HAL_AFIO_REMAP_SWJ_DISABLE();
 
   /* USER CODE BEGIN MspInit 1 */
+  boot_mark("HAL_Init");
 
   /* USER CODE END MspInit 1 */
 }
@@ -38,7 +38,7 @@
 #include "gpio.h"
 
 /* USER CODE BEGIN 0 */
-
+#include "utils/boot.h"
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart1;
@@ -70,6 +70,9 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
   if(uartHandle->Instance==USART1)
   {
   /* USER CODE BEGIN USART1_MspInit 0 */
+#if !BOOT_FAST
+    boot_mark("clock, GPIO");
+#endif
 
   /* USER CODE END USART1_MspInit 0 */
     /* Peripheral clock enable */
@@ -12,4 +12,11 @@
 #include <inttypes.h>
 #include <stm32f1xx_hal.h>
 
+/**
+ * Place a function in SRAM (.ramfunc, copied at startup with .data).
+ * Runs without flash wait states; use for short, hot code like ISRs.
+ * Calls between flash and RAM go through linker veneers.
+ */
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline))
+
 #endif //MPORK_COMMON_H
@@ -5,10 +5,12 @@
 #include <common.h>
 #include "utils/timebase.h"
 #include "utils/debug.h"
+#include "utils/stackmon.h"
 #include "handlers.h"
 
 /**
  * @brief Handle a button press. Delete if not needed - a possible callback for debouncer.
+ * Runs from the main loop (debo_dispatch), so blocking is fine.
  * @param button: button identifier
  * @param press: press state (1 = just pressed, 0 = just released)
  */
@@ -18,11 +20,27 @@ void ButtonHandler(uint32_t button, bool press)
 }
 
 /**
- * Increment timebase counter each ms.
- * This is called by HAL, weak override.
+ * @brief Handle an event from the debouncer. Called from the main loop (debo_dispatch).
+ * @param ev : the event
  */
-void HAL_SYSTICK_Callback(void)
+void GestureHandler(const debo_event_t *ev)
 {
+	static const char *const names[] = {"press", "release", "click", "long", "repeat", "chord"};
+
+	if (ev->type == DEBO_EV_PRESS || ev->type == DEBO_EV_RELEASE) return; // see ButtonHandler
+
+	dbg("Gesture %s on 0x%08"PRIx32", count %d", names[ev->type], ev->id, ev->count);
+}
+
+/**
+ * SysTick handler, installed with irq_install() in user_init().
+ * Replaces the generated SysTick_Handler -> HAL_SYSTICK_IRQHandler -> HAL_SYSTICK_Callback chain.
+ */
+RAMFUNC void user_SysTick_Handler(void)
+{
+	HAL_IncTick();
+	stack_isr_sample();
+	stack_guard_check();
 	timebase_ms_cb();
 }
 
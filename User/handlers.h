@@ -6,9 +6,14 @@
 #define MPORK_HANDLERS_H
 
 #include <common.h>
+#include "utils/debounce.h"
 
 void ButtonHandler(uint32_t button, bool press);
 
+void GestureHandler(const debo_event_t *ev);
+
+void user_SysTick_Handler(void);
+
 void user_Error_Handler();
 
 void user_assert_failed(uint8_t* file, uint32_t line);
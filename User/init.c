@@ -4,6 +4,13 @@
 
 #include <common.h>
 #include "utils/debounce.h"
+#include "utils/debug.h"
+#include "utils/itm.h"
+#include "utils/crashdump.h"
+#include "utils/stackmon.h"
+#include "utils/vectors.h"
+#include "utils/bench.h"
+#include "utils/boot.h"
 #include "init.h"
 #include "handlers.h"
 
@@ -14,6 +21,7 @@ static void init_buttons()
 	debo.debo_time = 50;
 	debo.GPIOx = GPIOB; // All buttons are on port B
 	debo.callback = ButtonHandler;
+	debo.use_exti = true; // no polling while idle
 
 	//debo.pin = BTN1_Pin;
 	//debo.cb_payload = 1;
@@ -23,8 +31,27 @@ static void init_buttons()
 /** Init the application */
 void user_init()
 {
+	vectors_init();
+	irq_install(SysTick_IRQn, user_SysTick_Handler);
+
+#if DEBUG_USE_ITM
+	itm_init(ITM_SWO_BAUD);
+#endif
+
 	timebase_init(5, 5);
+	boot_fast_continue();
 	debounce_init(4);
+	debo_set_event_handler(GestureHandler);
+	stackmon_init();
 
 	init_buttons();
+
+	// Report crashes from previous runs. They stay in flash until crashdump_clear().
+	if (crashdump_count() > 0) {
+		crashdump_report();
+	}
+
+#if BENCH_AT_BOOT
+	bench_run();
+#endif
 }
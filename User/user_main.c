@@ -5,21 +5,52 @@
 #include <common.h>
 #include "utils/timebase.h"
 #include "utils/debug.h"
+#include "utils/stackmon.h"
+#include "utils/malloc_safe.h"
+#include "utils/boot.h"
+#include "utils/pin.h"
 #include "user_main.h"
 #include "init.h"
+#include "handlers.h"
 
 /** Main function, called from MX-generated main.c */
 void user_main()
 {
+	// must come before anything touches stdout
+	debug_init();
+
 	banner("== USER CODE STARTING ==");
 
 	user_init();
+	boot_mark("user_init");
+
+	stack_report();
+#if MALLOC_TRACK
+	malloc_track_dump();
+#endif
 
 	ms_time_t counter1 = 0;
+	bool boot_reported = false;
 	while (1) {
+		// with BOOT_FAST, the PLL phase finishes here
+		boot_poll();
+		if (!boot_reported && boot_complete()) {
+			boot_report();
+			boot_reported = true;
+		}
+
 		if (ms_loop_elapsed(&counter1, 1000)) {
 			// Blink
-			HAL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin);
+			pin_toggle(LED1);
 		}
+
+		// button callbacks and gestures
+		debo_dispatch();
+
+		// stack usage check, flagged by the tick
+		stackmon_poll();
+
+		// send out any buffered printf() output
+		dbg_flush();
 	}
 }
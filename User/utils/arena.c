@@ -0,0 +1,106 @@
+#include <common.h>
+#include <string.h>
+
+#include "handlers.h"
+#include "arena.h"
+
+/** Linker symbols */
+extern uint8_t _sarena;
+extern uint8_t _earena;
+
+/** Offset of the first free byte */
+static volatile uint32_t arena_pos = 0;
+
+/** Max offset reached */
+static uint32_t arena_max = 0;
+
+
+/** Allocate a block */
+void *arena_alloc(size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	void *mem = NULL;
+	if (size <= arena_size() - arena_pos) {
+		mem = &_sarena + arena_pos;
+		arena_pos += size;
+		if (arena_pos > arena_max) arena_max = arena_pos;
+	}
+
+	__set_PRIMASK(primask);
+
+	return mem;
+}
+
+
+/** Allocate a zeroed block */
+void *arena_calloc(size_t nmemb, size_t size)
+{
+	size_t total = nmemb * size;
+	if (size != 0 && total / size != nmemb) return NULL;
+
+	void *mem = arena_alloc(total);
+	if (mem != NULL) memset(mem, 0, total);
+
+	return mem;
+}
+
+
+/** Get the current position */
+arena_mark_t arena_mark(void)
+{
+	return arena_pos;
+}
+
+
+/** Release everything allocated after the mark */
+void arena_reset(arena_mark_t mark)
+{
+	if (mark < arena_pos) arena_pos = mark;
+}
+
+
+/** Get the number of bytes allocated */
+size_t arena_used(void)
+{
+	return arena_pos;
+}
+
+
+/** Get the max number of bytes ever allocated */
+size_t arena_peak(void)
+{
+	return arena_max;
+}
+
+
+/** Get the arena size */
+size_t arena_size(void)
+{
+	return (size_t) (&_earena - &_sarena);
+}
+
+
+void *arena_alloc_safe_do(size_t size, const char* file, uint32_t line)
+{
+	void *mem = arena_alloc(size);
+	if (mem == NULL) {
+		user_error_file_line("Arena full", file, line);
+	}
+
+	return mem;
+}
+
+
+void *arena_calloc_safe_do(size_t nmemb, size_t size, const char* file, uint32_t line)
+{
+	void *mem = arena_calloc(nmemb, size);
+	if (mem == NULL) {
+		user_error_file_line("Arena full", file, line);
+	}
+
+	return mem;
+}
@@ -0,0 +1,62 @@
+#ifndef MPORK_ARENA_H
+#define MPORK_ARENA_H
+
+/**
+ * Bump allocator over a fixed RAM region (._arena in the linker script).
+ *
+ * No per-allocation header; blocks are only released all at once
+ * by rolling back to a mark. Use it for tables allocated once at init,
+ * and for scratch memory with a clear lifetime:
+ *
+ *   arena_mark_t m = arena_mark();
+ *   uint8_t *buf = arena_alloc(len);
+ *   ...
+ *   arena_reset(m);
+ *
+ * Allocation is safe from interrupts, but marks must be reset in LIFO order.
+ */
+
+#include <common.h>
+
+/** Alignment of returned blocks */
+#define ARENA_ALIGN 4
+
+/** Position in the arena, see arena_mark() */
+typedef uint32_t arena_mark_t;
+
+/**
+ * @brief Allocate a block.
+ * @param size : bytes
+ * @return the block (uninitialized), NULL if the arena is full
+ */
+void *arena_alloc(size_t size);
+
+/**
+ * @brief Allocate a zeroed block for nmemb elements.
+ * @return the block, NULL if the arena is full
+ */
+void *arena_calloc(size_t nmemb, size_t size);
+
+/** Get the current position, to roll back to with arena_reset() */
+arena_mark_t arena_mark(void);
+
+/** Release everything allocated after the mark */
+void arena_reset(arena_mark_t mark);
+
+/** Get the number of bytes allocated */
+size_t arena_used(void);
+
+/** Get the max number of bytes ever allocated */
+size_t arena_peak(void);
+
+/** Get the arena size (_Arena_Size in the linker script) */
+size_t arena_size(void);
+
+void *arena_alloc_safe_do(size_t size, const char* file, uint32_t line);
+void *arena_calloc_safe_do(size_t nmemb, size_t size, const char* file, uint32_t line);
+
+/** Like malloc_s() and calloc_s(), but from the arena */
+#define arena_alloc_s(size)        arena_alloc_safe_do(size,        __FILE__, __LINE__)
+#define arena_calloc_s(nmemb, size) arena_calloc_safe_do(nmemb, size, __FILE__, __LINE__)
+
+#endif //MPORK_ARENA_H
@@ -0,0 +1,446 @@
+#include <common.h>
+#include "bench.h"
+#include "cycles.h"
+#include "debug.h"
+#include "timebase.h"
+#include "debounce.h"
+#include "pin.h"
+
+/** A pin nothing on the board uses; it's only read, not configured */
+#define BENCH_PORT GPIOA
+#define BENCH_PIN GPIO_PIN_0
+
+/** Task for the scratch task tables */
+static void bench_dummy_task(void *unused)
+{
+	UNUSED(unused);
+}
+
+
+// region Flash vs RAM
+
+/** Scratch workload of bench_ramfunc() */
+#define BENCH_TICK_TASKS 4
+#define BENCH_TICK_PINS 4
+
+/** Measure a tick function, returns the min cycle count of BENCH_REPEAT runs (IRQs off) */
+static uint32_t bench_tick(void (*fn)(void))
+{
+	uint32_t best = UINT32_MAX;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	for (int i = 0; i < BENCH_REPEAT; i++) {
+		uint32_t start = cycles_now();
+		fn();
+		uint32_t took = cycles_now() - start;
+		if (took < best) best = took;
+	}
+
+	__set_PRIMASK(primask);
+
+	return best;
+}
+
+static void debo_tick_ram(void)
+{
+	debo_periodic_task(NULL);
+}
+
+static void debo_tick_flash(void)
+{
+	debo_periodic_task_flash(NULL);
+}
+
+
+/** Compare the SysTick hot path running from flash and from RAM */
+void bench_ramfunc(void)
+{
+	task_table_t tasks = timebase_alloc_tables(BENCH_TICK_TASKS, BENCH_TICK_TASKS);
+	debo_table_t pins = debo_alloc_table(BENCH_TICK_PINS);
+
+	if (tasks.periodic == NULL || pins.slots == NULL) {
+		warn("Bench flash vs RAM: out of memory");
+		timebase_free_tables(tasks);
+		debo_free_table(pins);
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	// The real tasks, pins and time are put aside, the ticks only see this
+	task_table_t saved_tasks = timebase_swap_tables(tasks);
+	debo_table_t saved_pins = debo_swap_table(pins);
+
+	for (int i = 0; i < BENCH_TICK_TASKS; i++) {
+		add_periodic_task(bench_dummy_task, NULL, (i & 1) ? 10 : 1, false);
+		schedule_task(bench_dummy_task, NULL, 60000, false); // counts down, never runs
+	}
+
+	// polled pins that can't settle during the bench, so no events are posted
+	debo_init_t init = {
+		.GPIOx = BENCH_PORT,
+		.pin = BENCH_PIN,
+		.debo_time = 60000,
+		.callback = NULL,
+		.use_exti = false,
+	};
+
+	debo_id_t ids[BENCH_TICK_PINS];
+	for (int i = 0; i < BENCH_TICK_PINS; i++) {
+		ids[i] = debo_register_pin(&init);
+	}
+
+	uint32_t tb_flash = bench_tick(timebase_ms_cb_flash);
+	uint32_t tb_ram = bench_tick(timebase_ms_cb);
+	uint32_t debo_flash = bench_tick(debo_tick_flash);
+	uint32_t debo_ram = bench_tick(debo_tick_ram);
+
+	for (int i = 0; i < BENCH_TICK_PINS; i++) {
+		debo_remove_pin(ids[i]);
+	}
+
+	debo_swap_table(saved_pins);
+	timebase_swap_tables(saved_tasks);
+
+	__set_PRIMASK(primask);
+
+	timebase_free_tables(tasks);
+	debo_free_table(pins);
+
+	info("Bench flash vs RAM (wait states %d): timebase_ms_cb flash %"PRIu32" cyc, RAM %"PRIu32" cyc",
+		 (int) (FLASH->ACR & FLASH_ACR_LATENCY), tb_flash, tb_ram);
+	info("Bench flash vs RAM: debo_periodic_task flash %"PRIu32" cyc, RAM %"PRIu32" cyc",
+		 debo_flash, debo_ram);
+}
+
+// endregion
+
+
+// region Delays
+
+/** Measure one delay, returns the cycle count (IRQs off) */
+static uint32_t measure_delay(bool ns, uint32_t value)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t start = cycles_now();
+	if (ns) {
+		delay_ns(value);
+	} else {
+		delay_us(value);
+	}
+	uint32_t took = cycles_now() - start;
+
+	__set_PRIMASK(primask);
+
+	return took;
+}
+
+
+/** Run the sweep in the current delay mode */
+static void delay_sweep(const char *mode)
+{
+	static const uint32_t us_values[] = {1, 2, 5, 10, 100, 1000};
+	static const uint32_t ns_values[] = {100, 250, 500};
+
+	for (size_t i = 0; i < sizeof(us_values) / sizeof(us_values[0]); i++) {
+		uint32_t want = us_values[i] * delay_cycles_per_us;
+		uint32_t got = measure_delay(false, us_values[i]);
+
+		dbg("%s delay_us(%4"PRIu32"): want %6"PRIu32" cyc, got %6"PRIu32" (%+d)",
+			mode, us_values[i], want, got, (int) (got - want));
+	}
+
+	for (size_t i = 0; i < sizeof(ns_values) / sizeof(ns_values[0]); i++) {
+		uint32_t want = (ns_values[i] * delay_cycles_per_us + 999) / 1000;
+		uint32_t got = measure_delay(true, ns_values[i]);
+
+		dbg("%s delay_ns(%4"PRIu32"): want %6"PRIu32" cyc, got %6"PRIu32" (%+d)",
+			mode, ns_values[i], want, got, (int) (got - want));
+	}
+}
+
+
+/** Compare requested and measured delays */
+void delay_selftest(void)
+{
+	info("Delay self-test at %"PRIu32" MHz (loop %"PRIu32"/16 cyc per iteration):",
+		 delay_cycles_per_us, delay_loop_cycles_x16);
+
+	bool use_dwt = delay_use_dwt;
+
+	delay_use_dwt = true;
+	delay_sweep("DWT ");
+
+	delay_use_dwt = false;
+	delay_sweep("loop");
+
+	delay_use_dwt = use_dwt;
+}
+
+// endregion
+
+
+// region Log lines
+
+/** Log lines printed by each variant */
+#define BENCH_LOG_LINES 8
+
+/**
+ * A log line sent the way debug.c did before lines were built in one buffer:
+ * colour, timestamp, tag, message, line ending and reset as separate writes.
+ */
+static void legacy_line(const char *fmt, ...)
+{
+	char buf[DEBUG_LINE_MAX];
+	ms_time_t now = ms_now();
+
+	dbg_sink_write("\033[33;1m", 7);
+
+	int n = snprintf(buf, sizeof(buf), "%4"PRIu32".%03"PRIu32" ", now / 1000, now % 1000);
+	dbg_sink_write(buf, (size_t) n);
+
+	dbg_sink_write(DEBUG_TAG_WARN, sizeof(DEBUG_TAG_WARN) - 1);
+
+	va_list va;
+	va_start(va, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	if (n < 0) n = 0;
+	if (n > (int) sizeof(buf) - 1) n = sizeof(buf) - 1;
+	dbg_sink_write(buf, (size_t) n);
+
+	dbg_sink_write(DEBUG_EOL, sizeof(DEBUG_EOL) - 1);
+	dbg_sink_write("\033[0m", 4);
+}
+
+
+/** Compare the per-line cost of the old and the current log output */
+void bench_log(void)
+{
+	dbg_flush();
+
+	// same text and colour for both
+	uint32_t calls = dbg_sink_count();
+	uint32_t start = cycles_now();
+	for (int i = 0; i < BENCH_LOG_LINES; i++) {
+		legacy_line("bench log line %d, value %d", i, i * 1000);
+	}
+	uint32_t legacy_cycles = (cycles_now() - start) / BENCH_LOG_LINES;
+	uint32_t legacy_calls = dbg_sink_count() - calls;
+
+	calls = dbg_sink_count();
+	start = cycles_now();
+	for (int i = 0; i < BENCH_LOG_LINES; i++) {
+		warn("bench log line %d, value %d", i, i * 1000);
+	}
+	uint32_t line_cycles = (cycles_now() - start) / BENCH_LOG_LINES;
+	uint32_t line_calls = dbg_sink_count() - calls;
+
+	info("Bench log line: separate writes %"PRIu32" cyc, %"PRIu32" writes; one buffer %"PRIu32" cyc, %"PRIu32" writes (per line)",
+		 legacy_cycles, legacy_calls / BENCH_LOG_LINES, line_cycles, line_calls / BENCH_LOG_LINES);
+}
+
+// endregion
+
+
+// region ID lookup
+
+/** Table sizes tried by bench_lookup() (max 255) */
+static const size_t bench_lookup_sizes[] = {8, 32, 128, 255};
+
+/** Lookup cycles at the first and last slot */
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+} lookup_cycles_t;
+
+
+/** Time a lookup for each ID. IRQs must be off. */
+static lookup_cycles_t lookup_time(bool (*lookup)(uint32_t), const uint32_t *ids, size_t n)
+{
+	lookup_cycles_t res = {0};
+
+	for (size_t i = 0; i < n; i++) {
+		uint32_t start = cycles_now();
+		(void) lookup(ids[i]);
+		uint32_t took = cycles_now() - start;
+
+		if (i == 0) res.first = took;
+		if (i == n - 1) res.last = took;
+	}
+
+	return res;
+}
+
+
+/** Fill a scratch debouncer table and time the lookups. IRQs must be off. */
+static void lookup_pins(debo_table_t table, uint32_t *ids,
+						lookup_cycles_t *indexed, lookup_cycles_t *linear, bool *stale_ok)
+{
+	debo_table_t saved = debo_swap_table(table);
+
+	debo_init_t init = {
+		.GPIOx = BENCH_PORT,
+		.pin = BENCH_PIN,
+		.debo_time = 0,
+		.callback = NULL,
+		.use_exti = false,
+	};
+
+	for (size_t i = 0; i < table.count; i++) {
+		ids[i] = debo_register_pin(&init);
+	}
+
+	*indexed = lookup_time(debo_pin_state, ids, table.count);
+	*linear = lookup_time(debo_pin_state_linear, ids, table.count);
+
+	// reuse the first slot, the old ID must not find it
+	debo_remove_pin(ids[0]);
+	debo_id_t fresh = debo_register_pin(&init);
+	*stale_ok = !debo_remove_pin(ids[0]) && debo_remove_pin(fresh);
+
+	for (size_t i = 1; i < table.count; i++) {
+		debo_remove_pin(ids[i]);
+	}
+
+	debo_swap_table(saved);
+}
+
+
+/** Fill a scratch future task table and time the lookups (aborts). IRQs must be off. */
+static void lookup_tasks(task_table_t table, uint32_t *ids,
+						 lookup_cycles_t *indexed, lookup_cycles_t *linear)
+{
+	task_table_t saved = timebase_swap_tables(table);
+
+	for (size_t i = 0; i < table.future_count; i++) {
+		ids[i] = schedule_task(bench_dummy_task, NULL, 60000, false);
+	}
+
+	*indexed = lookup_time(abort_scheduled_task, ids, table.future_count);
+
+	// the aborts emptied the table, fill it again
+	for (size_t i = 0; i < table.future_count; i++) {
+		ids[i] = schedule_task(bench_dummy_task, NULL, 60000, false);
+	}
+
+	*linear = lookup_time(abort_scheduled_task_linear, ids, table.future_count);
+
+	timebase_swap_tables(saved);
+}
+
+
+/** Time ID lookups */
+void bench_lookup(void)
+{
+	info("ID lookup, cycles at the first / last slot, by slot index vs linear search:");
+
+	for (size_t s = 0; s < sizeof(bench_lookup_sizes) / sizeof(bench_lookup_sizes[0]); s++) {
+		size_t size = bench_lookup_sizes[s];
+
+		// the tables are on the heap, allocated outside the IRQ-off section
+		uint32_t *ids = calloc(size, sizeof(uint32_t));
+		debo_table_t pin_table = debo_alloc_table(size);
+		task_table_t task_table = timebase_alloc_tables(0, size);
+
+		lookup_cycles_t pin_idx = {0}, pin_lin = {0};
+		lookup_cycles_t task_idx = {0}, task_lin = {0};
+		bool stale_ok = false;
+		bool pins_done = ids && pin_table.slots;
+		bool tasks_done = ids && task_table.future;
+
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+
+		if (pins_done) lookup_pins(pin_table, ids, &pin_idx, &pin_lin, &stale_ok);
+		if (tasks_done) lookup_tasks(task_table, ids, &task_idx, &task_lin);
+
+		__set_PRIMASK(primask);
+
+		timebase_free_tables(task_table);
+		debo_free_table(pin_table);
+		free(ids);
+
+		if (pins_done) {
+			dbg("%3d pins:  debo_pin_state %"PRIu32" / %"PRIu32", linear %"PRIu32" / %"PRIu32", stale ID %s",
+				(int) size, pin_idx.first, pin_idx.last, pin_lin.first, pin_lin.last,
+				stale_ok ? "rejected" : "ACCEPTED");
+		} else {
+			dbg("%3d pins:  skipped, out of memory", (int) size);
+		}
+
+		if (tasks_done) {
+			dbg("%3d tasks: abort_scheduled_task %"PRIu32" / %"PRIu32", linear %"PRIu32" / %"PRIu32,
+				(int) size, task_idx.first, task_idx.last, task_lin.first, task_lin.last);
+		} else {
+			dbg("%3d tasks: skipped, out of memory", (int) size);
+		}
+	}
+}
+
+// endregion
+
+
+// region GPIO
+
+/** Operations per measurement */
+#define BENCH_GPIO_OPS 8
+
+/** Time BENCH_GPIO_OPS repetitions of a statement, IRQs must be off */
+#define BENCH_GPIO(result, stmt) do { \
+		uint32_t start_ = cycles_now(); \
+		for (int i_ = 0; i_ < BENCH_GPIO_OPS; i_++) { stmt; } \
+		(result) = (cycles_now() - start_) / BENCH_GPIO_OPS; \
+	} while (0)
+
+
+/** Compare pin.h with HAL GPIO */
+void bench_gpio(void)
+{
+	uint32_t hal_toggle, hal_write, hal_read;
+	uint32_t pin_toggle_c, pin_write_c, pin_read_c;
+	volatile bool sink;
+
+	bool was = pin_read_out(LED1);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	BENCH_GPIO(hal_toggle, HAL_GPIO_TogglePin(LED1_GPIO_Port, LED1_Pin));
+	BENCH_GPIO(hal_write, HAL_GPIO_WritePin(LED1_GPIO_Port, LED1_Pin, GPIO_PIN_SET));
+	BENCH_GPIO(hal_read, sink = HAL_GPIO_ReadPin(LED1_GPIO_Port, LED1_Pin));
+
+	BENCH_GPIO(pin_toggle_c, pin_toggle(LED1));
+	BENCH_GPIO(pin_write_c, pin_set(LED1));
+	BENCH_GPIO(pin_read_c, sink = pin_read(LED1));
+
+	__set_PRIMASK(primask);
+
+	(void) sink;
+	pin_write(LED1, was);
+
+	info("GPIO, cycles per call (incl. loop):");
+	dbg("toggle: HAL %"PRIu32", pin.h %"PRIu32, hal_toggle, pin_toggle_c);
+	dbg("write:  HAL %"PRIu32", pin.h %"PRIu32, hal_write, pin_write_c);
+	dbg("read:   HAL %"PRIu32", pin.h %"PRIu32, hal_read, pin_read_c);
+}
+
+// endregion
+
+
+/** Run all benchmarks */
+void bench_run(void)
+{
+	cycles_init();
+
+	bench_ramfunc();
+	bench_log();
+	delay_selftest();
+	bench_lookup();
+	bench_gpio();
+}
@@ -0,0 +1,69 @@
+#ifndef MPORK_BENCH_H
+#define MPORK_BENCH_H
+
+/**
+ * Cycle-count benchmarks, printed to the debug output.
+ *
+ * Numbers depend on the clock (flash wait states) - compare them
+ * only between runs at the same frequency.
+ */
+
+#include <common.h>
+
+/** Run the benchmarks from user_init() */
+#ifndef BENCH_AT_BOOT
+#define BENCH_AT_BOOT 0
+#endif
+
+/** Repetitions of each measurement, the minimum is reported */
+#define BENCH_REPEAT 16
+
+/** Run all benchmarks */
+void bench_run(void);
+
+/**
+ * @brief Compare the SysTick hot path running from flash and from RAM (RAMFUNC).
+ *
+ * Times timebase_ms_cb() and debo_periodic_task() against flash builds
+ * of the same code. The ticks run on scratch tables (a few dummy tasks and
+ * polled pins that never settle), swapped in with interrupts disabled, so
+ * no real task runs, no event is posted and the time is restored after.
+ */
+void bench_ramfunc(void);
+
+/**
+ * @brief Compare the per-line cost of log output.
+ *
+ * Prints the same lines as separate sink writes (the old way) and with
+ * warn(), and reports cycles (the caller's latency, mostly UART time)
+ * and transport calls per line.
+ */
+void bench_log(void);
+
+/**
+ * @brief Compare requested and measured delays over a sweep.
+ *
+ * Runs delay_us() and delay_ns() with the DWT counter and with the
+ * fallback loop, and prints the measured cycle counts and errors.
+ */
+void delay_selftest(void);
+
+/**
+ * @brief Time ID lookups in the debouncer and timebase over several table sizes.
+ *
+ * Each size gets scratch tables on the heap (sizes that don't fit are
+ * skipped), filled with dummy entries on an unused pin and swapped in with
+ * interrupts disabled; the real tables are restored afterwards. Lookups by
+ * slot index are compared with the old linear search at the first and last
+ * slot. Also checks that a stale ID is rejected after its slot was reused.
+ */
+void bench_lookup(void);
+
+/**
+ * @brief Compare pin.h macros with the HAL GPIO calls.
+ *
+ * Toggles and reads the LED1 pin, which is left as it was.
+ */
+void bench_gpio(void);
+
+#endif //MPORK_BENCH_H
@@ -0,0 +1,142 @@
+#include <common.h>
+#include <gpio.h>
+#include "boot.h"
+#include "timebase.h"
+#include "debug.h"
+#include "clock.h"
+
+typedef struct {
+	const char *name;
+	uint32_t cycles; ///< CYCCNT at the end of the phase
+	uint32_t clock;  ///< SystemCoreClock at the end of the phase
+} boot_mark_t;
+
+static boot_mark_t boot_marks[BOOT_MARKS_MAX];
+static size_t boot_mark_count = 0;
+
+/** Accumulated time up to the last mark (us), the clock changes between phases */
+static uint32_t boot_us_total = 0;
+
+/** The fast boot is still finishing in the background */
+static bool boot_fast_pending = false;
+
+
+/** Convert cycles to us at the given clock */
+static inline uint32_t cycles_to_us(uint32_t cycles, uint32_t clock)
+{
+	return (uint32_t) (((uint64_t) cycles * 1000000) / clock);
+}
+
+
+/** Duration of a phase ending with mark i, in us */
+static uint32_t phase_us(size_t i)
+{
+	// Each phase is timed at the clock it started with. The clock switch
+	// happens late in its phase (after the HSE / PLL waits), so that's the
+	// better estimate.
+	uint32_t start = (i == 0) ? 0 : boot_marks[i - 1].cycles;
+	uint32_t clock = (i == 0) ? HSI_VALUE : boot_marks[i - 1].clock;
+
+	return cycles_to_us(boot_marks[i].cycles - start, clock);
+}
+
+
+/** Record the end of a boot phase */
+void boot_mark(const char *name)
+{
+	if (boot_mark_count >= BOOT_MARKS_MAX) return;
+
+	boot_mark_t *m = &boot_marks[boot_mark_count];
+	m->name = name;
+	m->cycles = DWT->CYCCNT;
+	m->clock = SystemCoreClock;
+
+	boot_us_total += phase_us(boot_mark_count);
+	boot_mark_count++;
+}
+
+
+/** Get the time since reset in microseconds */
+uint32_t boot_us(void)
+{
+	if (boot_mark_count == 0) {
+		return cycles_to_us(DWT->CYCCNT, HSI_VALUE);
+	}
+
+	const boot_mark_t *last = &boot_marks[boot_mark_count - 1];
+	return boot_us_total + cycles_to_us(DWT->CYCCNT - last->cycles, SystemCoreClock);
+}
+
+
+/** Print the boot phase durations */
+void boot_report(void)
+{
+	uint32_t total = 0;
+
+	info("Boot profile:");
+	for (size_t i = 0; i < boot_mark_count; i++) {
+		uint32_t us = phase_us(i);
+		total += us;
+
+		dbg("%-12s %7"PRIu32" us  (at %7"PRIu32" us, %2"PRIu32" MHz)",
+			boot_marks[i].name, us, total, boot_marks[i].clock / 1000000);
+	}
+}
+
+
+// region Fast boot
+
+#if BOOT_FAST
+/** When the HSE was started */
+static ms_time_t boot_hse_start = 0;
+#endif
+
+
+/** Start the HSE; boot_poll() switches to PLL when it's ready */
+void boot_fast_continue(void)
+{
+#if BOOT_FAST
+	RCC->CR |= RCC_CR_HSEON;
+	boot_hse_start = ms_now();
+	boot_fast_pending = true;
+#endif
+}
+
+
+/**
+ * Wait for the HSE, then switch and run the deferred init.
+ *
+ * Runs in the main loop, so the HAL timeouts in clock_set_profile()
+ * work and the warnings may block.
+ */
+void boot_poll(void)
+{
+#if BOOT_FAST
+	if (!boot_fast_pending) return;
+
+	if (!(RCC->CR & RCC_CR_HSERDY)) {
+		if (ms_elapsed(boot_hse_start) < BOOT_HSE_TIMEOUT) return;
+
+		// no crystal? stay on HSI
+		RCC->CR &= ~RCC_CR_HSEON;
+		warn("HSE did not start, running on HSI");
+	} else if (!clock_set_profile(CLOCK_72MHZ)) {
+		warn("PLL switch failed, running at %"PRIu32" Hz", SystemCoreClock);
+	}
+
+	// deferred peripheral init
+	MX_GPIO_Init();
+
+	boot_mark("PLL");
+	boot_fast_pending = false;
+#endif
+}
+
+
+/** Check if all boot phases are done */
+bool boot_complete(void)
+{
+	return !boot_fast_pending;
+}
+
+// endregion
@@ -0,0 +1,68 @@
+#ifndef MPORK_BOOT_H
+#define MPORK_BOOT_H
+
+/**
+ * Boot profiling and the fast-boot path.
+ *
+ * Reset_Handler starts the DWT cycle counter as its first instruction,
+ * boot_mark() records the count (and the core clock) at the end of each
+ * boot phase, and boot_report() prints the phase durations.
+ *
+ * With BOOT_FAST, main() skips the generated clock setup: the core keeps
+ * running on HSI (8 MHz) while USART1 comes up. boot_fast_continue()
+ * starts the HSE, and boot_poll() in the main loop switches to the 72 MHz
+ * PLL (with clock_set_profile()) once it's ready.
+ * MX_GPIO_Init() is deferred until after the switch.
+ */
+
+#include <common.h>
+
+/** Start on HSI, bring up the PLL in the background */
+#ifndef BOOT_FAST
+#define BOOT_FAST 0
+#endif
+
+/** Max number of boot marks */
+#define BOOT_MARKS_MAX 8
+
+/** Give up waiting for the HSE after this long (ms), stay on HSI */
+#define BOOT_HSE_TIMEOUT 100
+
+/**
+ * @brief Record the end of a boot phase.
+ *
+ * Only valid after .bss was cleared (i.e. from main() on).
+ *
+ * @param name : phase name, must be a literal (not copied)
+ */
+void boot_mark(const char *name);
+
+/** Print the boot phase durations to the debug output */
+void boot_report(void);
+
+/**
+ * @brief Check if all boot phases are done.
+ *
+ * With BOOT_FAST, the "PLL" phase ends in boot_poll() after user_init();
+ * wait for this before boot_report().
+ */
+bool boot_complete(void);
+
+/** Get the time since reset in microseconds, valid until the cycle counter wraps */
+uint32_t boot_us(void);
+
+/**
+ * @brief Finish the fast boot: start the HSE, boot_poll() does the rest.
+ *
+ * Call from user_init() after timebase_init(). No-op without BOOT_FAST.
+ */
+void boot_fast_continue(void);
+
+/**
+ * @brief Switch to PLL and run the deferred init once the HSE is ready.
+ *
+ * Call from the main loop. No-op without BOOT_FAST or when done.
+ */
+void boot_poll(void);
+
+#endif //MPORK_BOOT_H
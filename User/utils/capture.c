@@ -0,0 +1,390 @@
+#include <common.h>
+#include <string.h>
+#include "capture.h"
+#include "timhw.h"
+#include "timebase.h"
+#include "clock.h"
+
+/** Statistic sums; periods are kept as offsets from the first, so the squares stay small */
+typedef struct {
+	uint32_t count;
+	uint32_t ref;     ///< first period
+	int64_t sum;      ///< sum of (period - ref)
+	int64_t sum_sq;   ///< sum of (period - ref)^2
+	uint32_t high_count;
+	uint64_t high_sum;
+} capture_acc_t;
+
+struct capture {
+	TIM_HandleTypeDef htim;
+	uint8_t dma_edge;    ///< DMA1 channel of CH1
+	uint8_t dma_other;   ///< DMA1 channel of CH2, 0 = no duty
+	uint8_t prescaler;
+	uint32_t tick_hz;
+
+	uint16_t edge_ring[CAPTURE_RING];
+	uint16_t other_ring[CAPTURE_RING];
+	uint16_t edge_pos;   ///< read positions
+	uint16_t other_pos;
+	uint16_t edge_raw;   ///< last value read from the edge ring, to detect a lap
+
+	uint16_t now16;      ///< counter at the last tick
+	uint32_t now;        ///< extended counter at the last tick
+	uint32_t last_edge;  ///< extended time of the last measured edge
+	bool have_edge;
+	uint16_t idle_ms;
+
+	uint32_t last_period;
+	uint32_t overruns;
+	capture_acc_t acc;
+};
+
+static struct capture captures[CAPTURE_MAX];
+static size_t capture_count = 0;
+
+static void capture_task(void *unused);
+static void capture_retime(uint32_t hclk);
+
+
+/** Get the prescaler for a count rate up to CAPTURE_TICK_MAX */
+static uint32_t capture_psc(TIM_TypeDef *tim)
+{
+	return (tim_input_clock(tim) - 1) / CAPTURE_TICK_MAX;
+}
+
+
+/** Start a peripheral-to-memory circular DMA of 16-bit captures */
+static void capture_dma_start(uint8_t dma, volatile uint32_t *ccr, uint16_t *ring)
+{
+	DMA_Channel_TypeDef *ch = dma1_channel(dma);
+	ch->CCR = 0;
+	ch->CPAR = (uint32_t) ccr;
+	ch->CMAR = (uint32_t) ring;
+	ch->CNDTR = CAPTURE_RING;
+	DMA1->IFCR = dma1_flag(dma, DMA_IFCR_CGIF1);
+	ch->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_PL_1 | DMA_CCR_EN;
+}
+
+
+/** Configure the timer, pin and DMA and start measuring */
+capture_t *capture_init(const capture_init_t *init)
+{
+	static const uint32_t ic_psc[9] = {
+		[1] = TIM_ICPSC_DIV1, [2] = TIM_ICPSC_DIV2, [4] = TIM_ICPSC_DIV4, [8] = TIM_ICPSC_DIV8
+	};
+
+	uint8_t prescaler = init->prescaler ? init->prescaler : 1;
+	if (prescaler > 8 || (prescaler & (prescaler - 1)) || init->filter > 15) return NULL;
+	if (capture_count >= CAPTURE_MAX) return NULL;
+
+	uint8_t dma_edge = tim_cc_dma(init->tim, 1);
+	if (dma_edge == 0 || !tim_clock_enable(init->tim)) return NULL;
+
+	if (capture_count == 0) {
+		if (add_periodic_task(capture_task, NULL, 1, false) == PID_NONE) return NULL;
+		clock_add_listener(capture_retime);
+	}
+
+	struct capture *cap = &captures[capture_count];
+	memset(cap, 0, sizeof(struct capture));
+	cap->dma_edge = dma_edge;
+	cap->dma_other = tim_cc_dma(init->tim, 2);
+	cap->prescaler = prescaler;
+
+	tim_pin_init(init->tim, 1, GPIO_MODE_INPUT, init->pullup ? GPIO_PULLUP : GPIO_NOPULL);
+
+	TIM_HandleTypeDef *htim = &cap->htim;
+	htim->Instance = init->tim;
+	htim->State = HAL_TIM_STATE_RESET;
+	htim->Lock = HAL_UNLOCKED;
+	htim->Init.Prescaler = capture_psc(init->tim);
+	htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim->Init.Period = 0xFFFF;
+	htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim->Init.RepetitionCounter = 0;
+
+	if (HAL_TIM_IC_Init(htim) != HAL_OK) return NULL;
+
+	// CH1 and CH2 both capture TI1, on opposite edges
+	TIM_IC_InitTypeDef ic;
+	ic.ICPolarity = init->falling ? TIM_ICPOLARITY_FALLING : TIM_ICPOLARITY_RISING;
+	ic.ICSelection = TIM_ICSELECTION_DIRECTTI;
+	ic.ICPrescaler = ic_psc[prescaler];
+	ic.ICFilter = init->filter;
+	if (HAL_TIM_IC_ConfigChannel(htim, &ic, TIM_CHANNEL_1) != HAL_OK) return NULL;
+
+	ic.ICPolarity = init->falling ? TIM_ICPOLARITY_RISING : TIM_ICPOLARITY_FALLING;
+	ic.ICSelection = TIM_ICSELECTION_INDIRECTTI;
+	if (HAL_TIM_IC_ConfigChannel(htim, &ic, TIM_CHANNEL_2) != HAL_OK) return NULL;
+
+	__HAL_RCC_DMA1_CLK_ENABLE();
+	capture_dma_start(cap->dma_edge, &init->tim->CCR1, cap->edge_ring);
+	init->tim->DIER |= TIM_DIER_CC1DE;
+
+	if (cap->dma_other) {
+		capture_dma_start(cap->dma_other, &init->tim->CCR2, cap->other_ring);
+		init->tim->DIER |= TIM_DIER_CC2DE;
+		HAL_TIM_IC_Start(htim, TIM_CHANNEL_2);
+	}
+
+	HAL_TIM_IC_Start(htim, TIM_CHANNEL_1);
+
+	cap->tick_hz = tim_input_clock(init->tim) / (init->tim->PSC + 1);
+	cap->now16 = (uint16_t) init->tim->CNT;
+
+	// the tick only looks at registered captures
+	__DMB();
+	capture_count++;
+
+	return cap;
+}
+
+
+/** Get a DMA ring write position */
+static inline uint16_t ring_pos(uint8_t dma)
+{
+	return (uint16_t) ((CAPTURE_RING - dma1_channel(dma)->CNDTR) % CAPTURE_RING);
+}
+
+
+/** Extend a capture taken less than 65536 ticks before now16 */
+static inline uint32_t capture_ext(uint32_t now, uint16_t now16, uint16_t c)
+{
+	return now - (uint16_t) (now16 - c);
+}
+
+
+/** Drop all pending edges and restart the measurement */
+static void capture_resync(struct capture *cap, uint16_t edge_end, uint16_t other_end)
+{
+	cap->edge_pos = edge_end;
+	cap->other_pos = other_end;
+	cap->edge_raw = cap->edge_ring[(edge_end + CAPTURE_RING - 1) % CAPTURE_RING];
+	cap->have_edge = false;
+}
+
+
+/** Halve the sums, keeping the averages. The reference moves to the mean, so a drift doesn't grow the squares. */
+static void capture_acc_halve(capture_acc_t *acc)
+{
+	int64_t n = acc->count;
+	int64_t m = acc->sum / n;
+
+	// d' = d - m; sum' = sum - n*m (less than n), sum_sq' = sum_sq - 2*m*sum + n*m^2
+	int64_t rest = acc->sum - n * m;
+	acc->sum_sq -= m * acc->sum + m * rest;
+	acc->sum = rest;
+	acc->ref += (uint32_t) m;
+
+	acc->count /= 2;
+	acc->sum /= 2;
+	acc->sum_sq /= 2;
+	acc->high_count /= 2;
+	acc->high_sum /= 2;
+}
+
+
+/** Account a measured period (between prescaled edges) */
+static void capture_add_period(struct capture *cap, uint32_t period)
+{
+	capture_acc_t *acc = &cap->acc;
+
+	if (acc->count == 0) {
+		acc->ref = period;
+		acc->sum = 0;
+		acc->sum_sq = 0;
+	}
+	if (acc->count >= CAPTURE_STATS_MAX) capture_acc_halve(acc);
+
+	int32_t d = (int32_t) (period - acc->ref);
+	acc->sum += d;
+	acc->sum_sq += (int64_t) d * d;
+	acc->count++;
+
+	cap->last_period = period;
+}
+
+
+/** Account an opposite edge - the active time is its offset in the cycle */
+static void capture_add_other(struct capture *cap, uint32_t t)
+{
+	if (!cap->have_edge || cap->last_period == 0) return;
+
+	uint32_t cycle = cap->last_period / cap->prescaler;
+	if (cycle == 0) return;
+
+	cap->acc.high_count++;
+	cap->acc.high_sum += (t - cap->last_edge) % cycle;
+}
+
+
+/** Extend the new timestamps and update the statistics */
+static void capture_update(struct capture *cap)
+{
+	// ring positions first - everything before them was captured before now16
+	uint16_t edge_end = ring_pos(cap->dma_edge);
+	uint16_t other_end = cap->dma_other ? ring_pos(cap->dma_other) : 0;
+
+	uint16_t now16 = (uint16_t) cap->htim.Instance->CNT;
+	cap->now += (uint16_t) (now16 - cap->now16);
+	cap->now16 = now16;
+
+	// a lap overwrites the last slot we read
+	size_t last = (cap->edge_pos + CAPTURE_RING - 1) % CAPTURE_RING;
+	if (cap->edge_ring[last] != cap->edge_raw) {
+		cap->overruns++;
+		capture_resync(cap, edge_end, other_end);
+		return;
+	}
+
+	if (cap->edge_pos == edge_end) {
+		if (cap->idle_ms < CAPTURE_TIMEOUT) cap->idle_ms++;
+		else cap->have_edge = false;
+	} else {
+		cap->idle_ms = 0;
+	}
+
+	uint16_t e = cap->edge_pos;
+	uint16_t o = cap->other_pos;
+
+	// merge both rings in time order
+	while (e != edge_end || o != other_end) {
+		uint32_t te = capture_ext(cap->now, now16, cap->edge_ring[e]);
+
+		if (o != other_end) {
+			uint32_t to = capture_ext(cap->now, now16, cap->other_ring[o]);
+
+			if (e == edge_end || (int32_t) (to - te) < 0) {
+				capture_add_other(cap, to);
+				o = (uint16_t) ((o + 1) % CAPTURE_RING);
+				continue;
+			}
+		}
+
+		if (cap->have_edge) capture_add_period(cap, te - cap->last_edge);
+		cap->last_edge = te;
+		cap->have_edge = true;
+		cap->edge_raw = cap->edge_ring[e];
+		e = (uint16_t) ((e + 1) % CAPTURE_RING);
+	}
+
+	cap->edge_pos = e;
+	cap->other_pos = o;
+}
+
+
+/** Runs every ms */
+static void capture_task(void *unused)
+{
+	UNUSED(unused);
+
+	for (size_t i = 0; i < capture_count; i++) {
+		capture_update(&captures[i]);
+	}
+}
+
+
+/** Integer square root */
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t res = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > v) bit >>= 2;
+
+	while (bit != 0) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t) res;
+}
+
+
+/** Read the statistics */
+bool capture_get_stats(capture_t *cap, capture_stats_t *stats, bool reset)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	capture_acc_t acc = cap->acc;
+	stats->overruns = cap->overruns;
+	if (reset) {
+		cap->acc.count = 0;
+		cap->acc.high_count = 0;
+		cap->acc.high_sum = 0;
+	}
+
+	__set_PRIMASK(primask);
+
+	stats->count = acc.count;
+	if (acc.count == 0) {
+		stats->period = 0;
+		stats->jitter = 0;
+		stats->high = 0;
+		stats->duty = 0;
+		stats->freq_mhz = 0;
+		return false;
+	}
+
+	int64_t n = acc.count;
+	int64_t total = (int64_t) acc.ref * n + acc.sum; // sum of periods
+	// sum^2 would overflow; mean * sum can't exceed sum_sq
+	int64_t mean = acc.sum / n;
+	int64_t var = (acc.sum_sq - mean * acc.sum) / n;
+
+	stats->period = (uint32_t) ((total / n) / cap->prescaler);
+	stats->jitter = isqrt64((uint64_t) (var > 0 ? var : 0)) / cap->prescaler;
+	stats->freq_mhz = total ? (uint32_t) ((uint64_t) cap->tick_hz * 1000 * cap->prescaler * n / (uint64_t) total) : 0;
+
+	stats->high = acc.high_count ? (uint32_t) (acc.high_sum / acc.high_count) : 0;
+	stats->duty = stats->period ? (uint16_t) ((uint64_t) stats->high * 1000 / stats->period) : 0;
+
+	return true;
+}
+
+
+/** Get the last measured period */
+uint32_t capture_last_period(capture_t *cap)
+{
+	return cap->last_period / cap->prescaler;
+}
+
+
+/** Get the timer count rate */
+uint32_t capture_tick_hz(capture_t *cap)
+{
+	return cap->tick_hz;
+}
+
+
+/** The tick rate changed - reprogram the prescaler and start over */
+static void capture_retime(uint32_t hclk)
+{
+	UNUSED(hclk);
+
+	for (size_t i = 0; i < capture_count; i++) {
+		struct capture *cap = &captures[i];
+		TIM_TypeDef *tim = cap->htim.Instance;
+
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+
+		tim->PSC = capture_psc(tim);
+		tim->EGR = TIM_EGR_UG; // apply now (resets the counter)
+		cap->tick_hz = tim_input_clock(tim) / (tim->PSC + 1);
+		cap->now16 = (uint16_t) tim->CNT;
+		cap->acc.count = 0;
+		cap->acc.high_count = 0;
+		cap->acc.high_sum = 0;
+		cap->last_period = 0;
+		capture_resync(cap, ring_pos(cap->dma_edge), cap->dma_other ? ring_pos(cap->dma_other) : 0);
+
+		__set_PRIMASK(primask);
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef MPORK_CAPTURE_H
+#define MPORK_CAPTURE_H
+
+/**
+ * Input capture - frequency, period, jitter and duty of a pulse signal.
+ *
+ * The signal goes to the timer's CH1 pin. Its edges are timestamped in
+ * hardware (CH1 the measured edge, CH2 the opposite one) and moved to
+ * rings by DMA, so there is no interrupt per edge. The timebase tick
+ * extends the 16-bit timestamps to 32 bits and updates the statistics,
+ * at most CAPTURE_RING edges per ms - a fixed CPU load ceiling.
+ *
+ * The timer counts at up to CAPTURE_TICK_MAX, so it can't wrap twice
+ * between ticks. Faster signals (above ~60 kHz) need the input prescaler,
+ * which timestamps every 2nd, 4th or 8th edge; up to ~500 kHz with /8.
+ * Edges lost to a full ring are counted as overruns, and the measurement
+ * restarts cleanly.
+ *
+ * Statistics are accumulated until read; past CAPTURE_STATS_MAX periods
+ * the old ones are weighted down by halving.
+ *
+ * Requires timebase, uses one periodic task. Duty needs the timer's CH2
+ * DMA request (not available on TIM3).
+ */
+
+#include <common.h>
+
+/** Max number of capture timers */
+#define CAPTURE_MAX 2
+
+/** Timestamp ring length per channel (max edges per ms) */
+#define CAPTURE_RING 64
+
+/** Max timer count rate (Hz) - 65536 ticks must outlast 1 ms tick plus latency */
+#define CAPTURE_TICK_MAX 32000000
+
+/** No edge for this long (ms) - restart the measurement */
+#define CAPTURE_TIMEOUT 2000
+
+/** Periods accumulated before the statistics are halved */
+#define CAPTURE_STATS_MAX (1UL << 20)
+
+typedef struct {
+	TIM_TypeDef *tim;   ///< timer, signal on its CH1 pin
+	uint8_t prescaler;  ///< timestamp every n-th edge: 1, 2, 4 or 8 (0 = 1)
+	uint8_t filter;     ///< input filter 0-15 (see TIMx_CCMR1 ICxF)
+	bool falling;       ///< measure periods between falling edges, duty = low time
+	bool pullup;        ///< enable the pull-up (open collector sensors)
+} capture_init_t;
+
+/** Measurement statistics. Times are in timer ticks (see capture_tick_hz()), per signal cycle. */
+typedef struct {
+	uint32_t count;     ///< periods measured
+	uint32_t period;    ///< mean period
+	uint32_t jitter;    ///< standard deviation of the period
+	uint32_t high;      ///< mean active time (after the measured edge), 0 if unknown
+	uint16_t duty;      ///< active time / period, permille
+	uint32_t freq_mhz;  ///< mean frequency, millihertz
+	uint32_t overruns;  ///< times edges were lost (total)
+} capture_stats_t;
+
+typedef struct capture capture_t;
+
+/**
+ * @brief Configure the timer, pin and DMA and start measuring.
+ * @return the capture, NULL on failure
+ */
+capture_t *capture_init(const capture_init_t *init);
+
+/**
+ * @brief Read the statistics.
+ * @param stats : output
+ * @param reset : start a new window
+ * @return true if any period was measured
+ */
+bool capture_get_stats(capture_t *cap, capture_stats_t *stats, bool reset);
+
+/** Get the last measured period (ticks, per cycle), 0 if none */
+uint32_t capture_last_period(capture_t *cap);
+
+/** Get the timer count rate (Hz) */
+uint32_t capture_tick_hz(capture_t *cap);
+
+#endif //MPORK_CAPTURE_H
@@ -0,0 +1,117 @@
+#include <common.h>
+#include <usart.h>
+#include "clock.h"
+#include "timebase.h"
+
+static clock_listener_t clock_listeners[CLOCK_LISTENERS_MAX];
+static size_t clock_listener_count = 0;
+
+
+/** Register a clock change listener */
+bool clock_add_listener(clock_listener_t listener)
+{
+	if (clock_listener_count >= CLOCK_LISTENERS_MAX) return false;
+
+	clock_listeners[clock_listener_count++] = listener;
+	return true;
+}
+
+
+/** Get the current clock profile */
+clock_profile_t clock_get_profile(void)
+{
+	switch (SystemCoreClock) {
+		case 72000000: return CLOCK_72MHZ;
+		case 48000000: return CLOCK_48MHZ;
+		case 24000000: return CLOCK_24MHZ;
+		case 8000000: return CLOCK_8MHZ;
+		default: return (clock_profile_t) 0;
+	}
+}
+
+
+/** Retime the clock-derived peripherals */
+void clock_retime(void)
+{
+	SystemCoreClockUpdate();
+
+	// SysTick is retimed by HAL_RCC_ClockConfig() (HAL_InitTick)
+
+	if (huart1.Instance != NULL) {
+		huart1.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), huart1.Init.BaudRate);
+	}
+
+	delay_calibrate();
+
+	for (size_t i = 0; i < clock_listener_count; i++) {
+		clock_listeners[i](SystemCoreClock);
+	}
+}
+
+
+/** Switch SYSCLK to a source with the given flash latency */
+static bool clock_switch(uint32_t source, uint32_t apb1_div, uint32_t latency)
+{
+	RCC_ClkInitTypeDef clk;
+
+	clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+	clk.SYSCLKSource = source;
+	clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	clk.APB1CLKDivider = apb1_div;
+	clk.APB2CLKDivider = RCC_HCLK_DIV1;
+
+	return HAL_RCC_ClockConfig(&clk, latency) == HAL_OK;
+}
+
+
+/** Switch the core clock */
+bool clock_set_profile(clock_profile_t profile)
+{
+	uint32_t pll_mul;
+	uint32_t latency;
+
+	switch (profile) {
+		case CLOCK_72MHZ: pll_mul = RCC_PLL_MUL9; latency = FLASH_LATENCY_2; break;
+		case CLOCK_48MHZ: pll_mul = RCC_PLL_MUL6; latency = FLASH_LATENCY_1; break;
+		case CLOCK_24MHZ: pll_mul = RCC_PLL_MUL3; latency = FLASH_LATENCY_0; break;
+		case CLOCK_8MHZ: pll_mul = 0; latency = FLASH_LATENCY_0; break;
+		default: return false;
+	}
+
+	// let the last byte leave at the old baud rate
+	if (huart1.Instance != NULL) {
+		while (!(huart1.Instance->SR & USART_SR_TC));
+	}
+
+	// HSE on (no-op if running)
+	RCC_OscInitTypeDef osc;
+	osc.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+	osc.HSEState = RCC_HSE_ON;
+	osc.HSEPredivValue = RCC_HSE_PREDIV_DIV1;
+	osc.PLL.PLLState = RCC_PLL_NONE;
+	if (HAL_RCC_OscConfig(&osc) != HAL_OK) return false;
+
+	// move off the PLL, it can't be reconfigured while in use
+	bool suc = clock_switch(RCC_SYSCLKSOURCE_HSE, RCC_HCLK_DIV1, FLASH_LATENCY_0);
+
+	if (suc && pll_mul != 0) {
+		osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+		osc.PLL.PLLState = RCC_PLL_ON;
+		osc.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+		osc.PLL.PLLMUL = pll_mul;
+
+		// APB1 is limited to 36 MHz
+		suc = HAL_RCC_OscConfig(&osc) == HAL_OK
+			  && clock_switch(RCC_SYSCLKSOURCE_PLLCLK, (profile > 36) ? RCC_HCLK_DIV2 : RCC_HCLK_DIV1, latency);
+	} else if (suc) {
+		// save power
+		osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+		osc.PLL.PLLState = RCC_PLL_OFF;
+		HAL_RCC_OscConfig(&osc);
+	}
+
+	// retime even after a failure, the clock may have changed half way
+	clock_retime();
+
+	return suc;
+}
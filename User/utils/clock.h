@@ -0,0 +1,53 @@
+#ifndef MPORK_CLOCK_H
+#define MPORK_CLOCK_H
+
+/**
+ * Runtime clock scaling.
+ *
+ * clock_set_profile() reconfigures the PLL, bus prescalers and flash
+ * latency with HAL RCC, then retimes everything derived from the clock:
+ * SysTick (done by HAL), USART1 baud rate, the delay calibration,
+ * and any registered listeners (e.g. the ITM SWO prescaler).
+ *
+ * All profiles run from the 8 MHz HSE.
+ */
+
+#include <common.h>
+
+/** Clock profile, value is the core clock in MHz */
+typedef enum {
+	CLOCK_72MHZ = 72, ///< PLL x9, APB1 /2
+	CLOCK_48MHZ = 48, ///< PLL x6
+	CLOCK_24MHZ = 24, ///< PLL x3
+	CLOCK_8MHZ = 8,   ///< HSE direct, PLL off
+} clock_profile_t;
+
+/** Max number of clock change listeners */
+#define CLOCK_LISTENERS_MAX 6
+
+/** Called after a clock change, with the new HCLK in Hz */
+typedef void (*clock_listener_t)(uint32_t hclk);
+
+/**
+ * @brief Switch the core clock. Waits for UART output to drain first.
+ * @return success; on failure the previous clock is kept (if possible)
+ */
+bool clock_set_profile(clock_profile_t profile);
+
+/** Get the current clock profile (0 if the clock isn't one of the profiles) */
+clock_profile_t clock_get_profile(void);
+
+/**
+ * @brief Register a listener to be called after each clock change.
+ * @return success (false if the table is full)
+ */
+bool clock_add_listener(clock_listener_t listener);
+
+/**
+ * @brief Retime the clock-derived peripherals and notify the listeners.
+ *
+ * Called by clock_set_profile(); call it after changing clocks any other way.
+ */
+void clock_retime(void);
+
+#endif //MPORK_CLOCK_H
@@ -0,0 +1,57 @@
+#include <common.h>
+#include "cobs.h"
+
+
+/** Encode a buffer */
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t code_pos = 0; // where the current block's length code goes
+	size_t out = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (src[i] == 0) {
+			dst[code_pos] = code;
+			code_pos = out++;
+			code = 1;
+			continue;
+		}
+
+		dst[out++] = src[i];
+		code++;
+
+		if (code == 0xFF) {
+			// full block, start a new one
+			dst[code_pos] = code;
+			code_pos = out++;
+			code = 1;
+		}
+	}
+
+	dst[code_pos] = code;
+	return out;
+}
+
+
+/** Decode a buffer */
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < len) {
+		uint8_t code = src[in++];
+		if (code == 0 || in + code - 1 > len) return 0; // malformed
+
+		for (uint8_t i = 1; i < code; i++) {
+			dst[out++] = src[in++];
+		}
+
+		// implicit zero, except after a full block or at the end
+		if (code != 0xFF && in < len) {
+			dst[out++] = 0;
+		}
+	}
+
+	return out;
+}
@@ -0,0 +1,34 @@
+#ifndef MPORK_COBS_H
+#define MPORK_COBS_H
+
+/**
+ * Consistent Overhead Byte Stuffing.
+ *
+ * Encoded data contains no zero bytes, so 0x00 can be used as a frame delimiter.
+ * Overhead is 1 byte per started 254 bytes of input.
+ */
+
+#include <common.h>
+
+/** Worst-case encoded size for a given input length (without the delimiter) */
+#define COBS_MAX_ENCODED(len) ((len) + ((len) / 254) + 1)
+
+/**
+ * @brief Encode a buffer.
+ * @param src : input data
+ * @param len : input length
+ * @param dst : output buffer, at least COBS_MAX_ENCODED(len) bytes
+ * @return encoded length (the 0x00 delimiter is not added)
+ */
+size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+
+/**
+ * @brief Decode a buffer (without the delimiter).
+ * @param src : encoded data
+ * @param len : encoded length
+ * @param dst : output buffer, at least len bytes. May be the same as src.
+ * @return decoded length, 0 if the input is malformed
+ */
+size_t cobs_decode(const uint8_t *src, size_t len, uint8_t *dst);
+
+#endif //MPORK_COBS_H
@@ -0,0 +1,267 @@
+#include <common.h>
+#include <string.h>
+#include <stddef.h>
+#include "crashdump.h"
+#include "timebase.h"
+#include "debug.h"
+#include "crc.h"
+
+/** Slot size in flash (programmed in half-words, kept word aligned) */
+#define SLOT_SIZE ((sizeof(crashdump_t) + 3) & ~3UL)
+
+/** Part of the record covered by the CRC */
+#define CRC_OFFSET offsetof(crashdump_t, uptime_ms)
+
+/** Linker symbols */
+extern uint8_t _crashdump_start;
+extern uint8_t _crashdump_end;
+extern const uint8_t _build_id_note[];
+extern const uint8_t _build_id_note_end[];
+extern uint32_t _estack;
+
+/** Record is built here, the fault stack is too small for it */
+static crashdump_t record;
+
+/** The newest stored record, kept over the erase when the area is full */
+static crashdump_t kept;
+
+
+static inline size_t slot_count(void)
+{
+	return (size_t) (&_crashdump_end - &_crashdump_start) / SLOT_SIZE;
+}
+
+
+static inline const crashdump_t *slot_at(size_t i)
+{
+	return (const crashdump_t *) (&_crashdump_start + i * SLOT_SIZE);
+}
+
+
+/** Check if a slot is fully erased (a half-written one is not) */
+static bool slot_erased(const crashdump_t *slot)
+{
+	const uint32_t *p = (const uint32_t *) slot;
+
+	for (size_t i = 0; i < SLOT_SIZE / 4; i++) {
+		if (p[i] != 0xFFFFFFFF) return false;
+	}
+
+	return true;
+}
+
+
+/** Check if a slot holds a valid record */
+static bool record_valid(const crashdump_t *r)
+{
+	return r->magic == CRASHDUMP_MAGIC
+		   && r->version == CRASHDUMP_VERSION
+		   && r->size == sizeof(crashdump_t)
+		   && r->crc == crc32(0, (const uint8_t *) r + CRC_OFFSET, sizeof(crashdump_t) - CRC_OFFSET);
+}
+
+
+/** Get the firmware's GNU build ID */
+const uint8_t *crashdump_build_id(size_t *len)
+{
+	// note: namesz, descsz, type, name (padded to 4), desc
+	if (_build_id_note_end - _build_id_note < 16) {
+		*len = 0;
+		return NULL;
+	}
+
+	const uint32_t *note = (const uint32_t *) _build_id_note;
+	*len = note[1];
+	return _build_id_note + 12 + ((note[0] + 3) & ~3UL);
+}
+
+
+/** Program a buffer to flash in half-words. Flash must be unlocked. */
+static bool flash_write(uint32_t addr, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i += 2) {
+		uint16_t hw = (uint16_t) (data[i] | (data[i + 1] << 8));
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr + i, hw) != HAL_OK) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/** Erase the crash dump area. Flash must be unlocked. */
+static bool flash_erase_area(void)
+{
+	FLASH_EraseInitTypeDef erase;
+	uint32_t page_error;
+
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_1;
+	erase.PageAddress = (uint32_t) &_crashdump_start;
+	erase.NbPages = (uint32_t) (&_crashdump_end - &_crashdump_start) / FLASH_PAGE_SIZE;
+
+	return HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK;
+}
+
+
+/** Program a record to a slot. Flash must be unlocked. */
+static bool slot_write(const crashdump_t *slot, const crashdump_t *r)
+{
+	// magic goes last, so an interrupted write doesn't look valid
+	const uint8_t *bytes = (const uint8_t *) r;
+	return flash_write((uint32_t) slot + 4, bytes + 4, SLOT_SIZE - 4)
+		   && flash_write((uint32_t) slot, bytes, 4);
+}
+
+
+/** Store a crash record */
+bool crashdump_save(const uint32_t *frame, uint32_t exc_return, uint32_t ipsr)
+{
+	crashdump_t *r = &record;
+	memset(r, 0, sizeof(crashdump_t));
+
+	r->magic = CRASHDUMP_MAGIC;
+	r->version = CRASHDUMP_VERSION;
+	r->size = sizeof(crashdump_t);
+	r->uptime_ms = ms_now();
+
+	size_t id_len;
+	const uint8_t *id = crashdump_build_id(&id_len);
+	if (id_len > CRASHDUMP_BUILD_ID_LEN) id_len = CRASHDUMP_BUILD_ID_LEN;
+	memcpy(r->build_id, id, id_len);
+
+	r->sp = (uint32_t) frame;
+	r->exc_return = exc_return;
+	r->ipsr = ipsr;
+	r->cfsr = SCB->CFSR;
+	r->hfsr = SCB->HFSR;
+	r->mmfar = SCB->MMFAR;
+	r->bfar = SCB->BFAR;
+
+	if (frame != NULL) {
+		memcpy(r->regs, frame, sizeof(r->regs));
+
+		for (size_t i = 0; i < CRASHDUMP_STACK_WORDS; i++) {
+			if ((uint32_t) &frame[i] >= (uint32_t) &_estack) break;
+			r->stack[i] = frame[i];
+		}
+	}
+
+	for (size_t i = 0; i < CRASHDUMP_LOG_LINES; i++) {
+		const char *line = dbg_history(i);
+		if (line == NULL) break;
+		strncpy(r->log[i], line, CRASHDUMP_LOG_LEN - 1);
+	}
+
+	r->crc = crc32(0, (const uint8_t *) r + CRC_OFFSET, sizeof(crashdump_t) - CRC_OFFSET);
+
+	// find a free slot
+	const crashdump_t *slot = NULL;
+	for (size_t i = 0; i < slot_count(); i++) {
+		if (slot_erased(slot_at(i))) {
+			slot = slot_at(i);
+			break;
+		}
+	}
+
+	HAL_FLASH_Unlock();
+
+	bool suc = true;
+	if (slot == NULL) {
+		// full - start over, but keep the newest valid record (slots fill in order)
+		bool keep = false;
+		for (size_t i = slot_count(); slot_count() >= 2 && i-- > 0;) {
+			if (record_valid(slot_at(i))) {
+				memcpy(&kept, slot_at(i), sizeof(crashdump_t));
+				keep = true;
+				break;
+			}
+		}
+
+		suc = flash_erase_area();
+		slot = slot_at(0);
+
+		if (keep) {
+			suc = suc && slot_write(slot, &kept);
+			slot = slot_at(1);
+		}
+	}
+
+	suc = suc && slot_write(slot, r);
+
+	HAL_FLASH_Lock();
+
+	return suc;
+}
+
+
+/** Get the number of valid records */
+size_t crashdump_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < slot_count(); i++) {
+		if (record_valid(slot_at(i))) count++;
+	}
+
+	return count;
+}
+
+
+/** Get a stored record */
+const crashdump_t *crashdump_get(size_t n)
+{
+	for (size_t i = 0; i < slot_count(); i++) {
+		const crashdump_t *r = slot_at(i);
+		if (!record_valid(r)) continue;
+		if (n-- == 0) return r;
+	}
+
+	return NULL;
+}
+
+
+/** Print all stored records */
+void crashdump_report(void)
+{
+	size_t own_len;
+	const uint8_t *own_id = crashdump_build_id(&own_len);
+	if (own_len > CRASHDUMP_BUILD_ID_LEN) own_len = CRASHDUMP_BUILD_ID_LEN;
+
+	const crashdump_t *r;
+	for (size_t n = 0; (r = crashdump_get(n)) != NULL; n++) {
+		char id_hex[CRASHDUMP_BUILD_ID_LEN * 3];
+		hex_format(id_hex, sizeof(id_hex), r->build_id, CRASHDUMP_BUILD_ID_LEN);
+
+		bool same_fw = (own_len > 0) && (memcmp(own_id, r->build_id, own_len) == 0);
+
+		warn("Crash dump %d: exception %"PRIu32" after %"PRIu32" ms", (int) n, r->ipsr, r->uptime_ms);
+		dbg("Build ID %s (%s)", id_hex, same_fw ? "this firmware" : "different firmware");
+		dbg("PC  0x%08"PRIx32"  LR  0x%08"PRIx32"  SP  0x%08"PRIx32"  PSR 0x%08"PRIx32,
+			r->regs[6], r->regs[5], r->sp, r->regs[7]);
+		dbg("R0  0x%08"PRIx32"  R1  0x%08"PRIx32"  R2  0x%08"PRIx32"  R3  0x%08"PRIx32"  R12 0x%08"PRIx32,
+			r->regs[0], r->regs[1], r->regs[2], r->regs[3], r->regs[4]);
+		dbg("CFSR 0x%08"PRIx32"  HFSR 0x%08"PRIx32"  MMFAR 0x%08"PRIx32"  BFAR 0x%08"PRIx32,
+			r->cfsr, r->hfsr, r->mmfar, r->bfar);
+
+		for (int i = CRASHDUMP_LOG_LINES - 1; i >= 0; i--) {
+			if (r->log[i][0] == 0) continue;
+			dbg("log> %.*s", CRASHDUMP_LOG_LEN, r->log[i]);
+		}
+
+		dbg("Stack:");
+		dbg_hexdump_ex(r->stack, sizeof(r->stack), r->sp, HEXDUMP_ADDR);
+	}
+}
+
+
+/** Erase all stored records */
+bool crashdump_clear(void)
+{
+	HAL_FLASH_Unlock();
+	bool suc = flash_erase_area();
+	HAL_FLASH_Lock();
+
+	return suc;
+}
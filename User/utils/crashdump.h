@@ -0,0 +1,87 @@
+#ifndef MPORK_CRASHDUMP_H
+#define MPORK_CRASHDUMP_H
+
+/**
+ * Persistent crash dumps.
+ *
+ * The fault reporter stores a crash record in the last flash page
+ * (CRASHDUMP region in the linker script). Records survive reset and
+ * can be printed at boot, or read out with st-flash and decoded
+ * against the ELF with tools/crashdump.py.
+ *
+ * When all slots are used, the area is erased and only the newest record
+ * is written back (to the first slot), followed by the new one.
+ */
+
+#include <common.h>
+#include "debug.h"
+
+#define CRASHDUMP_MAGIC 0xC4A5D00D
+#define CRASHDUMP_VERSION 1
+
+/** Stack words saved from the exception frame up */
+#define CRASHDUMP_STACK_WORDS 32
+
+/** Log lines saved (newest first) */
+#define CRASHDUMP_LOG_LINES 4
+#define CRASHDUMP_LOG_LEN DEBUG_HISTORY_LEN
+
+/** Bytes of the GNU build ID saved */
+#define CRASHDUMP_BUILD_ID_LEN 8
+
+/**
+ * Crash record, as stored in flash.
+ * Keep in sync with tools/crashdump.py!
+ */
+typedef struct {
+	uint32_t magic;      ///< CRASHDUMP_MAGIC, written last
+	uint16_t version;    ///< CRASHDUMP_VERSION
+	uint16_t size;       ///< sizeof(crashdump_t)
+	uint32_t crc;        ///< CRC-32 of the rest of the record (after this field)
+	uint32_t uptime_ms;  ///< time since boot
+	uint8_t build_id[CRASHDUMP_BUILD_ID_LEN]; ///< GNU build ID prefix
+	uint32_t regs[8];    ///< stacked r0, r1, r2, r3, r12, lr, pc, xpsr (0 if the stack was invalid)
+	uint32_t sp;         ///< exception frame address
+	uint32_t exc_return; ///< EXC_RETURN
+	uint32_t ipsr;       ///< exception number
+	uint32_t cfsr;
+	uint32_t hfsr;
+	uint32_t mmfar;
+	uint32_t bfar;
+	uint32_t stack[CRASHDUMP_STACK_WORDS]; ///< stack contents from sp
+	char log[CRASHDUMP_LOG_LINES][CRASHDUMP_LOG_LEN]; ///< recent log lines
+} crashdump_t;
+
+/**
+ * @brief Store a crash record. Called from the fault reporter.
+ * @param frame      : exception frame, NULL if invalid
+ * @param exc_return : EXC_RETURN
+ * @param ipsr       : exception number
+ * @return success
+ */
+bool crashdump_save(const uint32_t *frame, uint32_t exc_return, uint32_t ipsr);
+
+/** Get the number of valid records in flash */
+size_t crashdump_count(void);
+
+/**
+ * @brief Get a stored record.
+ * @param n : record index, 0 = oldest
+ * @return the record (in flash), NULL if there's no such valid record
+ */
+const crashdump_t *crashdump_get(size_t n);
+
+/** Print all stored records to the debug output */
+void crashdump_report(void);
+
+/** Erase all stored records */
+bool crashdump_clear(void);
+
+/**
+ * @brief Get the firmware's GNU build ID.
+ * @param len : output, ID length in bytes (0 if not linked with --build-id)
+ * @return pointer to the ID bytes
+ */
+const uint8_t *crashdump_build_id(size_t *len);
+
+#endif //MPORK_CRASHDUMP_H
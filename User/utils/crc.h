@@ -0,0 +1,37 @@
+#ifndef MPORK_CRC_H
+#define MPORK_CRC_H
+
+/**
+ * Table-driven checksums (4-bit tables, to keep the flash footprint small).
+ */
+
+#include <common.h>
+
+/** Initial value for crc16_ccitt() */
+#define CRC16_INIT 0xFFFF
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, MSB first, no final XOR).
+ *
+ * Can be called repeatedly to checksum data in parts.
+ *
+ * @param crc : CRC16_INIT or result of a previous call
+ * @param buf : data
+ * @param len : data length
+ * @return updated CRC
+ */
+uint16_t crc16_ccitt(uint16_t crc, const void *buf, size_t len);
+
+/**
+ * @brief CRC-32 (IEEE 802.3, same as zlib's crc32()).
+ *
+ * Can be called repeatedly to checksum data in parts.
+ *
+ * @param crc : 0 or result of a previous call
+ * @param buf : data
+ * @param len : data length
+ * @return updated CRC
+ */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+
+#endif //MPORK_CRC_H
@@ -0,0 +1,29 @@
+#ifndef MPORK_CYCLES_H
+#define MPORK_CYCLES_H
+
+/**
+ * Cycle counting with the DWT cycle counter (CYCCNT).
+ *
+ *   uint32_t start = cycles_now();
+ *   ...
+ *   uint32_t took = cycles_now() - start;
+ *
+ * The counter wraps every 2^32 cycles (~60 s at 72 MHz).
+ */
+
+#include <common.h>
+
+/** Enable the cycle counter (harmless if already running) */
+static inline void cycles_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/** Get the current cycle count */
+static inline uint32_t cycles_now(void)
+{
+	return DWT->CYCCNT;
+}
+
+#endif //MPORK_CYCLES_H
@@ -1,7 +1,8 @@
 #include <common.h>
 #include "debounce.h"
 #include "timebase.h"
-#include "malloc_safe.h"
+#include "arena.h"
+#include "vectors.h"
 
 // ms debounce time
 
@@ -18,8 +19,27 @@ typedef struct {
 	ms_time_t counter_0;         ///< counter for falling edge (ms)
 	ms_time_t counter_1;         ///< counter for rising edge (ms)
 	void (*callback)(uint32_t, bool);
+	bool use_exti;               ///< armed on EXTI, polled only while unsettled
+	volatile bool unsettled;     ///< EXTI pin is being polled (line masked)
+	ms_time_t quiet;             ///< time the input has been stable (ms)
+
+	bool gestures;               ///< gesture detection enabled
+	bool gesture_done;           ///< long press, repeat or chord happened - no click
+	uint8_t clicks;              ///< clicks waiting for the multi-click window to end
+	uint8_t repeats;             ///< repeat counter
+	uint16_t held;               ///< time pressed (ms, saturates)
+	uint16_t since_release;      ///< time since the last click (ms)
+	uint16_t repeat_wait;        ///< time to the next repeat (ms)
+	debo_gesture_t gesture;      ///< gesture timing
 } debo_slot_t;
 
+typedef struct {
+	debo_id_t id;
+	uint8_t slots[DEBO_CHORD_PINS]; ///< member slot indices
+	uint8_t count;
+	bool fired;                     ///< emitted, waiting for a release
+} debo_chord_t;
+
 
 /** Number of allocated slots */
 static size_t debo_slot_count = 0;
@@ -27,39 +47,436 @@ static size_t debo_slot_count = 0;
 /** Slots array */
 static debo_slot_t *debo_slots;
 
-/** Next free pin ID for make_id() */
-static debo_id_t next_pin_id = 1;
+/** Generation for the next pin ID, see make_id() */
+static uint32_t next_pin_gen = 0;
+
+/** The polling task */
+static task_pid_t debo_task_pid = PID_NONE;
+
+/** Number of registered pins without EXTI, the task can't be stopped while there are any */
+static size_t debo_polled_count = 0;
+
+/** EXTI lines in use */
+static uint16_t debo_exti_lines = 0;
+
+static debo_chord_t debo_chords[DEBO_CHORDS_MAX];
+static size_t debo_chord_count = 0;
+
+/** Event ring. Written in the tick, read by debo_dispatch(). */
+static debo_event_t debo_events[DEBO_EVENT_QUEUE];
+static volatile uint8_t debo_ev_head = 0; ///< next write
+static volatile uint8_t debo_ev_tail = 0; ///< next read
+static volatile uint32_t debo_ev_dropped = 0;
+
+static void (*debo_event_handler)(const debo_event_t *) = NULL;
+static void (*debo_ext_handler)(const debo_event_t *) = NULL;
 
-void debo_periodic_task(void *unused);
+
+// ID = gen << 8 | (index + 1), bits 31 and 30 are left for DEBO_CHORD_FLAG and DEBO_EXT_FLAG
+#define ID_INDEX_BITS 8
+#define ID_INDEX_MASK ((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK (DEBO_EXT_FLAG - 1)
 
 
 /**
- * @brief Get a valid free pin ID for a new entry.
+ * @brief Make a pin ID for a slot. Never DEBO_PIN_NONE.
  * @return the ID.
  */
-static debo_id_t make_id(void)
+static debo_id_t make_id(size_t index)
 {
-	debo_id_t id = next_pin_id++;
+	return ((next_pin_gen++ << ID_INDEX_BITS) & ID_GEN_MASK) | (debo_id_t) (index + 1);
+}
 
-	// make sure no task is given PID 0
-	if (next_pin_id == DEBO_PIN_NONE) {
-		next_pin_id++;
-	}
 
-	return id;
+/** Find a slot by ID, NULL if not found or stale */
+static debo_slot_t *find_slot(debo_id_t pin_id)
+{
+	size_t i = (size_t) (pin_id & ID_INDEX_MASK) - 1;
+	if (pin_id == DEBO_PIN_NONE || i >= debo_slot_count) return NULL;
+
+	debo_slot_t *slot = &debo_slots[i];
+	return (slot->id == pin_id) ? slot : NULL;
 }
 
 
 /** Init the debouncer */
 void debounce_init(size_t slot_count)
 {
-	debo_slots = calloc_s(slot_count, sizeof(debo_slot_t));
+	// the slot index must fit in an ID
+	if (slot_count > ID_INDEX_MASK) slot_count = ID_INDEX_MASK;
+
+	debo_slots = arena_calloc_s(slot_count, sizeof(debo_slot_t));
 	debo_slot_count = slot_count;
 
-	add_periodic_task(debo_periodic_task, NULL, 1, false);
+	// started by the first registered pin
+	debo_task_pid = add_periodic_task(debo_periodic_task, NULL, 1, false);
+	enable_periodic_task(debo_task_pid, false);
+}
+
+
+debo_table_t debo_alloc_table(size_t slot_count)
+{
+	if (slot_count > ID_INDEX_MASK) slot_count = ID_INDEX_MASK;
+
+	debo_table_t table = {
+		.slots = calloc(slot_count, sizeof(debo_slot_t)),
+		.count = slot_count,
+		.polled = 0,
+		.chords = 0,
+	};
+
+	if (table.slots == NULL) table.count = 0;
+	return table;
+}
+
+
+void debo_free_table(debo_table_t table)
+{
+	free(table.slots);
+}
+
+
+debo_table_t debo_swap_table(debo_table_t table)
+{
+	debo_table_t old = {
+		.slots = debo_slots,
+		.count = debo_slot_count,
+		.polled = debo_polled_count,
+		.chords = debo_chord_count,
+	};
+
+	// chords hold slot indices of the old table, they are hidden with it
+	debo_slots = table.slots;
+	debo_slot_count = table.count;
+	debo_polled_count = table.polled;
+	debo_chord_count = table.chords;
+
+	return old;
+}
+
+
+// region EXTI
+
+/** Get the EXTI line number of a pin mask */
+static inline uint32_t exti_line(uint16_t pin)
+{
+	return (uint32_t) __builtin_ctz(pin);
+}
+
+
+/** Get the IRQ serving an EXTI line */
+static IRQn_Type exti_irqn(uint32_t line)
+{
+	if (line <= 4) return (IRQn_Type) (EXTI0_IRQn + line);
+	if (line <= 9) return EXTI9_5_IRQn;
+	return EXTI15_10_IRQn;
+}
+
+
+/**
+ * Mask or unmask EXTI lines.
+ *
+ * IMR is shared by the EXTI ISR, the tick (re-arm) and the main loop
+ * (remove), so its read-modify-write must not be preempted.
+ */
+static inline __attribute__((always_inline)) void exti_set_mask(uint32_t lines, bool enable)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (enable) {
+		EXTI->IMR |= lines;
+	} else {
+		EXTI->IMR &= ~lines;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+
+/** Edge on an armed pin - mask the line and start polling */
+static RAMFUNC void debo_exti_isr(void)
+{
+	uint32_t pending = EXTI->PR & EXTI->IMR & debo_exti_lines;
+
+	exti_set_mask(pending, false);
+	EXTI->PR = pending;
+
+	for (size_t i = 0; i < debo_slot_count; i++) {
+		debo_slot_t *slot = &debo_slots[i];
+		if (slot->id == DEBO_PIN_NONE || !(slot->pin & pending)) continue;
+
+		slot->quiet = 0;
+		slot->unsettled = true;
+	}
+
+	enable_periodic_task(debo_task_pid, true);
+}
+
+
+/** Route the pin's EXTI line to its port and enable both edges (line stays masked) */
+static void exti_setup(debo_slot_t *slot)
+{
+	uint32_t line = exti_line(slot->pin);
+	uint32_t port = ((uint32_t) slot->GPIOx - GPIOA_BASE) / (GPIOB_BASE - GPIOA_BASE);
+
+	__HAL_RCC_AFIO_CLK_ENABLE();
+
+	uint32_t shift = (line & 3) * 4;
+	AFIO->EXTICR[line >> 2] = (AFIO->EXTICR[line >> 2] & ~(0xFUL << shift)) | (port << shift);
+
+	EXTI->RTSR |= slot->pin;
+	EXTI->FTSR |= slot->pin;
+	EXTI->EMR &= ~slot->pin;
+
+	IRQn_Type irq = exti_irqn(line);
+	irq_install(irq, debo_exti_isr);
+	HAL_NVIC_SetPriority(irq, DEBO_EXTI_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(irq);
+}
+
+
+/** Unmask the line after the pin settled. Returns false if it changed meanwhile. */
+static bool exti_rearm(debo_slot_t *slot)
+{
+	EXTI->PR = slot->pin;
+	exti_set_mask(slot->pin, true);
+
+	// an edge between the last poll and now would have been missed
+	bool state = HAL_GPIO_ReadPin(slot->GPIOx, slot->pin);
+	if (slot->invert) state = !state;
+
+	return state == slot->state;
+}
+
+// endregion
+
+
+// region Gestures
+
+/** Queue an event (tick side) */
+static bool post_event(debo_id_t id, debo_event_type_t type, uint8_t count)
+{
+	uint8_t head = debo_ev_head;
+	uint8_t next = (uint8_t) ((head + 1) & (DEBO_EVENT_QUEUE - 1));
+
+	if (next == debo_ev_tail) {
+		debo_ev_dropped++;
+		return false;
+	}
+
+	debo_event_t *ev = &debo_events[head];
+	ev->id = id;
+	ev->time = ms_now();
+	ev->type = (uint8_t) type;
+	ev->count = count;
+
+	__DMB(); // publish the data before the index
+	debo_ev_head = next;
+	return true;
+}
+
+
+/** Queue an event from another input module */
+bool debo_post_event(debo_id_t id, debo_event_type_t type, uint8_t count)
+{
+	return post_event(id | DEBO_EXT_FLAG, type, count);
+}
+
+
+/** Take an event from the queue (main loop side) */
+static bool take_event(debo_event_t *ev)
+{
+	uint8_t tail = debo_ev_tail;
+	if (tail == debo_ev_head) return false;
+
+	__DMB();
+	*ev = debo_events[tail];
+	__DMB();
+
+	debo_ev_tail = (uint8_t) ((tail + 1) & (DEBO_EVENT_QUEUE - 1));
+	return true;
+}
+
+
+/** Get the number of events lost to a full queue */
+uint32_t debo_events_dropped(void)
+{
+	return debo_ev_dropped;
+}
+
+
+/** Debounced edge on a pin with gestures */
+static void gesture_edge(debo_slot_t *slot, bool pressed)
+{
+	if (pressed) {
+		slot->held = 0;
+		slot->repeats = 0;
+		slot->gesture_done = false;
+		slot->repeat_wait = slot->gesture.repeat_delay;
+	} else {
+		if (!slot->gesture_done) {
+			if (slot->clicks < UINT8_MAX) slot->clicks++;
+			slot->since_release = 0;
+
+			if (slot->gesture.multi_click == 0) {
+				post_event(slot->id, DEBO_EV_CLICK, slot->clicks);
+				slot->clicks = 0;
+			}
+		}
+	}
+}
+
+
+/** Advance the gesture timers. Returns true if the pin needs more ticks. */
+static bool gesture_tick(debo_slot_t *slot)
+{
+	const debo_gesture_t *g = &slot->gesture;
+
+	if (slot->state) {
+		if (slot->held < UINT16_MAX) slot->held++;
+
+		if (g->long_press != 0 && !slot->gesture_done && slot->held == g->long_press) {
+			post_event(slot->id, DEBO_EV_LONG, 0);
+			slot->gesture_done = true;
+			slot->clicks = 0;
+		}
+
+		if (g->repeat_delay != 0 && --slot->repeat_wait == 0) {
+			post_event(slot->id, DEBO_EV_REPEAT, ++slot->repeats);
+			slot->gesture_done = true;
+			slot->repeat_wait = (g->repeat_rate != 0) ? g->repeat_rate : g->repeat_delay;
+		}
+
+		// held long enough for everything - no need to keep ticking
+		bool long_pending = (g->long_press != 0 && !slot->gesture_done);
+		return long_pending || g->repeat_delay != 0;
+	}
+
+	if (slot->clicks > 0) {
+		if (++slot->since_release >= g->multi_click) {
+			post_event(slot->id, DEBO_EV_CLICK, slot->clicks);
+			slot->clicks = 0;
+			return false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+
+/** Check the chords, after the pin states were updated */
+static void chords_tick(void)
+{
+	for (size_t c = 0; c < debo_chord_count; c++) {
+		debo_chord_t *chord = &debo_chords[c];
+		if (chord->count == 0) continue; // disabled, a member pin was removed
+
+		bool all = true;
+		for (size_t i = 0; i < chord->count; i++) {
+			all &= debo_slots[chord->slots[i]].state;
+		}
+
+		if (all && !chord->fired) {
+			chord->fired = true;
+			post_event(chord->id, DEBO_EV_CHORD, 0);
+
+			for (size_t i = 0; i < chord->count; i++) {
+				debo_slot_t *slot = &debo_slots[chord->slots[i]];
+				slot->gesture_done = true;
+				slot->clicks = 0;
+			}
+		} else if (!all) {
+			chord->fired = false;
+		}
+	}
+}
+
+
+/** Set the event handler */
+void debo_set_event_handler(void (*handler)(const debo_event_t *))
+{
+	debo_event_handler = handler;
+}
+
+
+/** Set the hook for external events */
+void debo_set_ext_handler(void (*handler)(const debo_event_t *))
+{
+	debo_ext_handler = handler;
 }
 
 
+/** Run callbacks for queued events */
+void debo_dispatch(void)
+{
+	debo_event_t ev;
+
+	while (take_event(&ev)) {
+		if (ev.id & DEBO_EXT_FLAG) {
+			if (debo_ext_handler != NULL) {
+				debo_ext_handler(&ev);
+			}
+		} else if (ev.type == DEBO_EV_PRESS || ev.type == DEBO_EV_RELEASE) {
+			// the pin may have been removed meanwhile
+			debo_slot_t *slot = find_slot(ev.id);
+			if (slot != NULL && slot->callback != NULL) {
+				slot->callback(slot->cb_payload, ev.type == DEBO_EV_PRESS);
+			}
+		}
+
+		if (debo_event_handler != NULL) {
+			debo_event_handler(&ev);
+		}
+	}
+}
+
+
+/** Enable gesture detection on a pin */
+bool debo_set_gestures(debo_id_t pin_id, const debo_gesture_t *gesture)
+{
+	debo_slot_t *slot = find_slot(pin_id);
+	if (slot == NULL) return false;
+
+	slot->gesture = *gesture;
+	slot->clicks = 0;
+	slot->held = 0;
+	slot->repeat_wait = gesture->repeat_delay;
+	slot->gesture_done = slot->state; // already held - wait for a release
+	slot->gestures = true;
+
+	return true;
+}
+
+
+/** Register a chord */
+debo_id_t debo_add_chord(const debo_id_t *pins, size_t count)
+{
+	if (debo_chord_count >= DEBO_CHORDS_MAX || count < 2 || count > DEBO_CHORD_PINS) {
+		return DEBO_PIN_NONE;
+	}
+
+	debo_chord_t *chord = &debo_chords[debo_chord_count];
+
+	for (size_t i = 0; i < count; i++) {
+		debo_slot_t *slot = find_slot(pins[i]);
+		if (slot == NULL || !slot->gestures) return DEBO_PIN_NONE;
+
+		chord->slots[i] = (uint8_t) (slot - debo_slots);
+	}
+
+	chord->count = (uint8_t) count;
+	chord->fired = false;
+	chord->id = DEBO_CHORD_FLAG | (debo_chord_count + 1);
+
+	debo_chord_count++;
+	return chord->id;
+}
+
+// endregion
+
+
 /** Register a pin */
 debo_id_t debo_register_pin(debo_init_t *init)
 {
@@ -81,7 +498,26 @@ debo_id_t debo_register_pin(debo_init_t *init)
 		if (slot->invert) state = !state;
 		slot->state = state;
 
-		slot->id = make_id();
+		slot->use_exti = init->use_exti;
+		slot->quiet = 0;
+		slot->gestures = false;
+
+		if (slot->use_exti) {
+			if (debo_exti_lines & slot->pin) return DEBO_PIN_NONE; // line taken
+
+			debo_exti_lines |= slot->pin;
+			exti_setup(slot);
+
+			// settle once by polling, then arm
+			slot->unsettled = true;
+		} else {
+			slot->unsettled = false;
+			debo_polled_count++;
+		}
+
+		slot->id = make_id(i);
+
+		enable_periodic_task(debo_task_pid, true);
 
 		return slot->id;
 	}
@@ -90,46 +526,105 @@ debo_id_t debo_register_pin(debo_init_t *init)
 }
 
 
-/** Callback that must be called every 1 ms */
-void debo_periodic_task(void *unused)
+/** Report a debounced edge */
+static inline void debo_edge(debo_slot_t *slot, bool state)
 {
-	UNUSED(unused);
+	slot->state = state;
 
-	for (size_t i = 0; i < debo_slot_count; i++) {
-		debo_slot_t *slot = &debo_slots[i];
-		if (slot->id == DEBO_PIN_NONE) continue; // unused
+	// the callback runs from debo_dispatch()
+	post_event(slot->id, state ? DEBO_EV_PRESS : DEBO_EV_RELEASE, 0);
 
-		bool state = HAL_GPIO_ReadPin(slot->GPIOx, slot->pin);
-		if (slot->invert) state = !state;
+	if (slot->gestures) {
+		gesture_edge(slot, state);
+	}
+}
 
-		if (slot->state != state) {
-			if (state == 0) {
-				// falling
 
-				if (slot->counter_0++ == slot->debo_time) {
-					slot->state = 0;
+/** Poll a pin. Returns true if it needs polling in the next tick. */
+static inline bool debo_poll(debo_slot_t *slot)
+{
+	bool state = HAL_GPIO_ReadPin(slot->GPIOx, slot->pin);
+	if (slot->invert) state = !state;
 
-					if (slot->callback != NULL) {
-						slot->callback(slot->cb_payload, false);
-					}
-				}
-			} else {
-				// rising
+	if (slot->state != state) {
+		slot->quiet = 0;
 
-				if (slot->counter_1++ == slot->debo_time) {
-					slot->state = 1;
+		if (state == 0) {
+			// falling
 
-					if (slot->callback != NULL) {
-						slot->callback(slot->cb_payload, true);
-					}
-				}
+			if (slot->counter_0++ == slot->debo_time) {
+				debo_edge(slot, false);
 			}
 		} else {
-			// reset counters
-			slot->counter_0 = 0;
-			slot->counter_1 = 0;
+			// rising
+
+			if (slot->counter_1++ == slot->debo_time) {
+				debo_edge(slot, true);
+			}
+		}
+	} else {
+		// reset counters
+		slot->counter_0 = 0;
+		slot->counter_1 = 0;
+
+		// EXTI pin quiet for a debounce time - wait for the next edge
+		if (slot->use_exti && slot->quiet++ >= slot->debo_time) {
+			slot->quiet = 0;
+			if (exti_rearm(slot)) {
+				slot->unsettled = false;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/** Body of the debounce tick, built into debo_periodic_task() (RAM) and debo_periodic_task_flash() */
+static inline __attribute__((always_inline)) void debo_tick(void)
+{
+	bool busy = (debo_polled_count > 0);
+
+	for (size_t i = 0; i < debo_slot_count; i++) {
+		debo_slot_t *slot = &debo_slots[i];
+		if (slot->id == DEBO_PIN_NONE) continue; // unused
+
+		// EXTI pins which are armed wait for an edge
+		if (!slot->use_exti || slot->unsettled) {
+			busy |= debo_poll(slot);
+		}
+
+		if (slot->gestures) {
+			busy |= gesture_tick(slot);
 		}
 	}
+
+	if (debo_chord_count > 0) {
+		chords_tick();
+	}
+
+	// Nothing to poll, the EXTI will wake us.
+	// The EXTI ISR can't preempt this (SysTick has higher priority), so no edge is lost.
+	if (!busy) {
+		enable_periodic_task(debo_task_pid, false);
+	}
+}
+
+
+/** Callback that must be called every 1 ms */
+RAMFUNC void debo_periodic_task(void *unused)
+{
+	UNUSED(unused);
+	debo_tick();
+}
+
+
+/** The same tick running from flash, to measure the RAMFUNC gain */
+void __attribute__((noinline)) debo_periodic_task_flash(void *unused)
+{
+	UNUSED(unused);
+	debo_tick();
 }
 
 
@@ -139,14 +634,22 @@ void debo_periodic_task(void *unused)
  * @return true if the pin is registered and is HIGH
  */
 bool debo_pin_state(debo_id_t pin_id)
+{
+	debo_slot_t *slot = find_slot(pin_id);
+	if (slot == NULL) return false;
+
+	return slot->state;
+}
+
+
+/** debo_pin_state() with a linear search for the ID */
+bool debo_pin_state_linear(debo_id_t pin_id)
 {
 	if (pin_id == DEBO_PIN_NONE) return false;
 
 	for (size_t i = 0; i < debo_slot_count; i++) {
 		debo_slot_t *slot = &debo_slots[i];
-		if (slot->id != pin_id) continue;
-
-		return slot->state;
+		if (slot->id == pin_id) return slot->state;
 	}
 
 	return false;
@@ -160,15 +663,29 @@ bool debo_pin_state(debo_id_t pin_id)
  */
 bool debo_remove_pin(debo_id_t pin_id)
 {
-	if (pin_id == DEBO_PIN_NONE) return false;
+	debo_slot_t *slot = find_slot(pin_id);
+	if (slot == NULL) return false;
+
+	if (slot->use_exti) {
+		exti_set_mask(slot->pin, false);
+		debo_exti_lines &= ~slot->pin;
+	} else {
+		debo_polled_count--;
+	}
 
-	for (size_t i = 0; i < debo_slot_count; i++) {
-		debo_slot_t *slot = &debo_slots[i];
-		if (slot->id != pin_id) continue;
+	// chords keep slot indices, they must not follow a new pin into the slot
+	uint8_t index = (uint8_t) (slot - debo_slots);
+	for (size_t c = 0; c < debo_chord_count; c++) {
+		debo_chord_t *chord = &debo_chords[c];
 
-		slot->id = DEBO_PIN_NONE;
-		return true;
+		for (size_t i = 0; i < chord->count; i++) {
+			if (chord->slots[i] == index) {
+				chord->count = 0;
+				break;
+			}
+		}
 	}
 
-	return false;
+	slot->id = DEBO_PIN_NONE;
+	return true;
 }
@@ -5,8 +5,24 @@
 #include "timebase.h"
 
 // Debouncer requires that you set up timebase first.
+//
+// Pins are either polled every ms, or (with use_exti) armed on an EXTI
+// edge interrupt and polled only while bouncing. When all pins are EXTI
+// pins and settled, the polling task is disabled.
+//
+// Debounced edges and gestures are queued as events in the tick (SysTick
+// interrupt); debo_dispatch() in the main loop runs the pin callbacks and
+// the event handler, so user code never runs in the interrupt.
 
-/** Debounced pin ID - used for state readout */
+/** EXTI interrupt priority, must be below SysTick (which runs the polling task) */
+#define DEBO_EXTI_PRIORITY 3
+
+/**
+ * Debounced pin ID - used for state readout.
+ *
+ * Encodes the slot index and a generation, so lookup is O(1)
+ * and IDs of removed pins are rejected even after slot reuse.
+ */
 typedef uint32_t debo_id_t;
 
 /** debo_id_t indicating unused slot */
@@ -20,7 +36,35 @@ typedef uint32_t debo_id_t;
  *
  * @param pin_count : number of pin slots to allocate
  */
-void debounce_init(size_t pin_count);
+void debounce_init(size_t pin_count); // max 255 pins
+
+
+/** A pin slot table with its counters, see debo_swap_table() */
+typedef struct {
+	void *slots;
+	size_t count;
+	size_t polled; ///< pins without EXTI
+	size_t chords; ///< chords in use, a new table has none
+} debo_table_t;
+
+/**
+ * @brief Allocate an empty slot table on the heap (for benchmarks).
+ * @return the table, slots is NULL if out of memory
+ */
+debo_table_t debo_alloc_table(size_t pin_count);
+
+/** Free a table from debo_alloc_table() */
+void debo_free_table(debo_table_t table);
+
+/**
+ * @brief Install another slot table (for benchmarks).
+ *
+ * Pins in the old table are not reachable until it is swapped back.
+ * Call with interrupts disabled, and remove the pins before swapping back.
+ *
+ * @return the previous table
+ */
+debo_table_t debo_swap_table(debo_table_t table);
 
 
 typedef struct {
@@ -29,7 +73,8 @@ typedef struct {
 	bool invert;                  ///< invert value read from GPIO (button to ground)
 	ms_time_t debo_time;          ///< debounce time in ms, 0 = default (20 ms)
 	uint32_t cb_payload;          ///< Value passed to the callback func
-	void (*callback)(uint32_t, bool); ///< callback
+	void (*callback)(uint32_t, bool); ///< callback, run by debo_dispatch()
+	bool use_exti;                ///< wait for edges on EXTI instead of polling; the EXTI line (pin number) must be free
 } debo_init_t;
 
 
@@ -42,6 +87,116 @@ typedef struct {
 debo_id_t debo_register_pin(debo_init_t *init_struct);
 
 
+// region Gestures
+
+/** Max number of chords */
+#define DEBO_CHORDS_MAX 2
+
+/** Max pins in a chord */
+#define DEBO_CHORD_PINS 4
+
+/** Event queue length (power of 2) */
+#define DEBO_EVENT_QUEUE 16
+
+/** Chord IDs have this bit set, to tell them from pin IDs in events */
+#define DEBO_CHORD_FLAG 0x80000000
+
+/** IDs of events from other input modules (e.g. the keypad) have this bit set */
+#define DEBO_EXT_FLAG 0x40000000
+
+/** Gesture timing for a pin, in ms. 0 disables the gesture, except repeat_rate. */
+typedef struct {
+	uint16_t long_press;   ///< hold time for DEBO_EV_LONG (suppresses the click)
+	uint16_t multi_click;  ///< max gap between clicks counted together
+	uint16_t repeat_delay; ///< hold time before the first DEBO_EV_REPEAT, 0 = no repeat
+	uint16_t repeat_rate;  ///< interval of the following repeats, 0 = same as repeat_delay
+} debo_gesture_t;
+
+/** Event type */
+typedef enum {
+	DEBO_EV_PRESS,   ///< debounced edge to high (after invert), all pins
+	DEBO_EV_RELEASE, ///< debounced edge to low, all pins
+	DEBO_EV_CLICK,   ///< short press(es) ended, 'count' = number of clicks
+	DEBO_EV_LONG,    ///< held for long_press
+	DEBO_EV_REPEAT,  ///< auto-repeat while held, 'count' = repeat number (wraps)
+	DEBO_EV_CHORD,   ///< all pins of a chord pressed, 'id' = chord ID
+} debo_event_type_t;
+
+/** Debouncer event */
+typedef struct {
+	debo_id_t id;     ///< pin or chord ID
+	ms_time_t time;   ///< timestamp
+	uint8_t type;     ///< debo_event_type_t
+	uint8_t count;    ///< click or repeat count
+} debo_event_t;
+
+/**
+ * @brief Enable gesture detection on a pin. "Pressed" is the high (after invert) state.
+ *
+ * The pin then also emits gesture events, see debo_set_event_handler().
+ * Gestures are timed by the debounce tick, no extra tasks are used.
+ *
+ * @param pin_id : Slot ID
+ * @param gesture : timing, copied
+ * @return success
+ */
+bool debo_set_gestures(debo_id_t pin_id, const debo_gesture_t *gesture);
+
+/**
+ * @brief Register a chord - pins pressed together.
+ *
+ * DEBO_EV_CHORD is emitted when all the pins are down; clicks and long
+ * presses of the member pins are suppressed until they are released.
+ * Removing a member pin disables the chord for good (its slot stays used).
+ *
+ * @param pins  : pin IDs (must have gestures enabled)
+ * @param count : number of pins, max DEBO_CHORD_PINS
+ * @return chord ID (with DEBO_CHORD_FLAG), DEBO_PIN_NONE on failure
+ */
+debo_id_t debo_add_chord(const debo_id_t *pins, size_t count);
+
+/** Set a handler receiving all events (edges and gestures), called by debo_dispatch() */
+void debo_set_event_handler(void (*handler)(const debo_event_t *));
+
+/**
+ * @brief Run the pin callbacks and the event handler for queued events.
+ *
+ * Call from the main loop.
+ */
+void debo_dispatch(void);
+
+/** Get the number of events lost to a full queue */
+uint32_t debo_events_dropped(void);
+
+/**
+ * @brief Queue an event from another input module.
+ *
+ * The queue has a single producer: call this only from timebase
+ * tasks (SysTick), like the debounce tick itself.
+ *
+ * @param id    : event source ID, with DEBO_EXT_FLAG
+ * @param type  : event type
+ * @param count : click / repeat count
+ * @return false if the queue was full
+ */
+bool debo_post_event(debo_id_t id, debo_event_type_t type, uint8_t count);
+
+/**
+ * @brief Set a hook for events with DEBO_EXT_FLAG, called by debo_dispatch()
+ * before the event handler. Used by input modules to run their own callbacks.
+ */
+void debo_set_ext_handler(void (*handler)(const debo_event_t *));
+
+// endregion
+
+
+/** The debounce tick, run every ms by a timebase task */
+void debo_periodic_task(void *unused);
+
+/** The debounce tick built to run from flash, for benchmarks (same effect as the tick) */
+void debo_periodic_task_flash(void *unused);
+
+
 /**
  * @brief Check if a pin is high
  * @param pin_id : Slot ID
@@ -49,9 +204,12 @@ debo_id_t debo_register_pin(debo_init_t *init_struct);
  */
 bool debo_pin_state(debo_id_t pin_id);
 
+/** debo_pin_state() with a linear search for the ID, as before IDs held the slot index (for benchmarks) */
+bool debo_pin_state_linear(debo_id_t pin_id);
+
 
 /**
- * @brief Remove a pin entry from the debouncer.
+ * @brief Remove a pin entry from the debouncer. Chords with the pin are disabled.
  * @param pin_id : Slot ID
  * @return true if task found & removed.
  */
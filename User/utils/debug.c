@@ -5,6 +5,106 @@
 #include "debug.h"
 #include "timebase.h"
 
+#if DEBUG_USE_ITM
+#include "itm.h"
+#else
+#include <usart.h>
+#include "telemetry.h"
+#endif
+
+
+// Attributes used by the log functions
+#define ATTR_INFO   "\033[37m"
+#define ATTR_BANNER "\033[32;1m"
+#define ATTR_WARN   "\033[33;1m"
+#define ATTR_ERROR  "\033[31;1m"
+#define ATTR_RESET  "\033[0m"
+
+/** Number of dbg_sink_write() calls (transport invocations) */
+static volatile uint32_t dbg_sink_calls = 0;
+
+/** Buffer for stdout, replaces the one newlib would malloc() */
+static char stdout_buf[DEBUG_STDOUT_BUF];
+
+
+#if DEBUG_HISTORY
+/** Ring of recent log lines */
+static char history[DEBUG_HISTORY][DEBUG_HISTORY_LEN];
+static size_t history_next = 0;
+#endif
+
+
+/** Init the debug output */
+void debug_init(void)
+{
+	setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+}
+
+
+/** Send raw bytes to the debug sink */
+void dbg_sink_write(const char *buf, size_t len)
+{
+	dbg_sink_calls++;
+
+#if DEBUG_USE_ITM
+	itm_write(ITM_CH_LOG, buf, len);
+#else
+	if (telem_text_framing()) {
+		telem_text(buf, len);
+	} else {
+		// timeout scaled to the length: 10 bits per byte, +2 ms margin
+		uint32_t timeout = (len * 10000) / huart1.Init.BaudRate + 2;
+		HAL_UART_Transmit(&huart1, (uint8_t *) buf, (uint16_t) len, timeout);
+	}
+#endif
+}
+
+
+/** Get the number of sink writes */
+uint32_t dbg_sink_count(void)
+{
+	return dbg_sink_calls;
+}
+
+
+/** Get a recent log line */
+const char *dbg_history(size_t n)
+{
+#if DEBUG_HISTORY
+	if (n >= DEBUG_HISTORY) return NULL;
+
+	const char *line = history[(history_next + DEBUG_HISTORY - 1 - n) % DEBUG_HISTORY];
+	return (line[0] != 0) ? line : NULL;
+#else
+	UNUSED(n);
+	return NULL;
+#endif
+}
+
+
+/** Store a log line in the history */
+static void history_add(const char *line, size_t len)
+{
+#if DEBUG_HISTORY
+	char *slot = history[history_next];
+	history_next = (history_next + 1) % DEBUG_HISTORY;
+
+	if (len > DEBUG_HISTORY_LEN - 1) len = DEBUG_HISTORY_LEN - 1;
+	for (size_t i = 0; i < len; i++) slot[i] = line[i];
+	slot[len] = 0;
+#else
+	UNUSED(line);
+	UNUSED(len);
+#endif
+}
+
+
+/** Flush buffered stdout */
+void dbg_flush(void)
+{
+	fflush(stdout);
+}
+
 
 void dbg_printf(const char *fmt, ...)
 {
@@ -14,18 +114,86 @@ void dbg_printf(const char *fmt, ...)
 	va_end(va);
 }
 
-void dbg_va_base(const char *fmt, const char *tag, va_list va)
+
+/** Append a string to the line buffer, returns new length */
+static size_t line_append(char *line, size_t pos, size_t cap, const char *str)
+{
+	while (*str != 0 && pos < cap) {
+		line[pos++] = *str++;
+	}
+	return pos;
+}
+
+
+/** Format the "ssss.mmm " timestamp, returns new length */
+static size_t line_timestamp(char *line, size_t pos)
 {
 	ms_time_t now = ms_now();
 	uint32_t secs = now / 1000;
 	uint32_t ms = now % 1000;
 
-	printf("%4"PRIu32".%03"PRIu32" ", secs, ms);
+	char digits[10];
+	size_t n = 0;
+	do {
+		digits[n++] = (char) ('0' + secs % 10);
+		secs /= 10;
+	} while (secs != 0);
 
-	dbg_raw(tag);
+	for (size_t i = n; i < 4; i++) line[pos++] = ' ';
+	while (n > 0) line[pos++] = digits[--n];
 
-	vprintf(fmt, va);
-	dbg_raw(DEBUG_EOL);
+	line[pos++] = '.';
+	line[pos++] = (char) ('0' + ms / 100);
+	line[pos++] = (char) ('0' + (ms / 10) % 10);
+	line[pos++] = (char) ('0' + ms % 10);
+	line[pos++] = ' ';
+
+	return pos;
+}
+
+
+/**
+ * @brief Build a complete log line and send it with one sink write.
+ * @param attr : ANSI attribute prefix, or NULL
+ * @param tag  : level tag
+ * @param fmt  : format
+ * @param va   : arguments
+ */
+static void dbg_line(const char *attr, const char *tag, const char *fmt, va_list va)
+{
+	char line[DEBUG_LINE_MAX];
+
+	// room kept for the line ending
+	const size_t tail = sizeof(DEBUG_EOL) - 1 + ((attr != NULL) ? sizeof(ATTR_RESET) - 1 : 0);
+	const size_t cap = sizeof(line) - tail;
+
+	// keep ordering with buffered printf() output. Not from ISR, the stdout buffer isn't reentrant.
+	if (__get_IPSR() == 0) dbg_flush();
+
+	size_t pos = 0;
+	if (attr != NULL) pos = line_append(line, pos, cap, attr);
+
+	size_t text_start = pos;
+	pos = line_timestamp(line, pos);
+	pos = line_append(line, pos, cap, tag);
+
+	int n = vsnprintf(&line[pos], cap - pos, fmt, va);
+	if (n > 0) {
+		pos += ((size_t) n < cap - pos) ? (size_t) n : cap - pos - 1; // truncated
+	}
+
+	history_add(&line[text_start], pos - text_start);
+
+	pos = line_append(line, pos, sizeof(line), DEBUG_EOL);
+	if (attr != NULL) pos = line_append(line, pos, sizeof(line), ATTR_RESET);
+
+	dbg_sink_write(line, pos);
+}
+
+
+void dbg_va_base(const char *fmt, const char *tag, va_list va)
+{
+	dbg_line(NULL, tag, fmt, va);
 }
 
 /** Print a log message with a DEBUG tag and newline */
@@ -41,14 +209,10 @@ void dbg(const char *fmt, ...)
 /** Print a log message with an INFO tag and newline */
 void info(const char *fmt, ...)
 {
-	v100_attr(FMT_WHITE);
-
 	va_list va;
 	va_start(va, fmt);
-	dbg_va_base(fmt, DEBUG_TAG_INFO, va);
+	dbg_line(ATTR_INFO, DEBUG_TAG_INFO, fmt, va);
 	va_end(va);
-
-	v100_attr(FMT_RESET);
 }
 
 
@@ -56,64 +220,138 @@ void info(const char *fmt, ...)
 /** Print a log message with an INFO tag and newline */
 void banner(const char *fmt, ...)
 {
-	v100_attr(FMT_GREEN, FMT_BRIGHT);
-
 	va_list va;
 	va_start(va, fmt);
-	dbg_va_base(fmt, DEBUG_TAG_INFO, va);
+	dbg_line(ATTR_BANNER, DEBUG_TAG_INFO, fmt, va);
 	va_end(va);
-
-	v100_attr(FMT_RESET);
 }
 
 
 /** Print a log message with a warning tag and newline */
 void warn(const char *fmt, ...)
 {
-	v100_attr(FMT_YELLOW, FMT_BRIGHT);
-
 	va_list va;
 	va_start(va, fmt);
-	dbg_va_base(fmt, DEBUG_TAG_WARN, va);
+	dbg_line(ATTR_WARN, DEBUG_TAG_WARN, fmt, va);
 	va_end(va);
-
-	v100_attr(FMT_RESET);
 }
 
 
 /** Print a log message with an ERROR tag and newline */
 void error(const char *fmt, ...)
 {
-	v100_attr(FMT_RED, FMT_BRIGHT);
-
 	va_list va;
 	va_start(va, fmt);
-	dbg_va_base(fmt, DEBUG_TAG_ERROR, va);
+	dbg_line(ATTR_ERROR, DEBUG_TAG_ERROR, fmt, va);
 	va_end(va);
+}
+
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+
+/** Dump memory as hex, with addresses and ASCII */
+void dbg_hexdump(const void *addr, size_t len)
+{
+	dbg_hexdump_ex(addr, len, (uint32_t) (uintptr_t) addr, HEXDUMP_ADDR | HEXDUMP_ASCII);
+}
+
+
+/** Dump memory as hex */
+void dbg_hexdump_ex(const void *addr, size_t len, uint32_t base, uint32_t flags)
+{
+	// "aaaaaaaa  " + "xx " * 16 + " " + " |" + 16 + "|" + EOL
+	char row[10 + HEXDUMP_ROW * 3 + 1 + 2 + HEXDUMP_ROW + 1 + sizeof(DEBUG_EOL)];
+	const uint8_t *p = addr;
+
+	if (__get_IPSR() == 0) dbg_flush();
+
+	for (size_t off = 0; off < len; off += HEXDUMP_ROW) {
+		size_t n = (len - off < HEXDUMP_ROW) ? len - off : HEXDUMP_ROW;
+		size_t pos = 0;
+
+		if (flags & HEXDUMP_ADDR) {
+			uint32_t a = base + off;
+			for (int shift = 28; shift >= 0; shift -= 4) {
+				row[pos++] = hex_digits[(a >> shift) & 0x0F];
+			}
+			row[pos++] = ' ';
+			row[pos++] = ' ';
+		}
+
+		for (size_t i = 0; i < HEXDUMP_ROW; i++) {
+			if (i == HEXDUMP_ROW / 2) row[pos++] = ' ';
+
+			if (i < n) {
+				row[pos++] = hex_digits[p[off + i] >> 4];
+				row[pos++] = hex_digits[p[off + i] & 0x0F];
+			} else if (flags & HEXDUMP_ASCII) {
+				// pad so the ASCII column lines up
+				row[pos++] = ' ';
+				row[pos++] = ' ';
+			} else {
+				break;
+			}
+			row[pos++] = ' ';
+		}
+
+		if (flags & HEXDUMP_ASCII) {
+			row[pos++] = ' ';
+			row[pos++] = '|';
+			for (size_t i = 0; i < n; i++) {
+				uint8_t c = p[off + i];
+				row[pos++] = (c >= 32 && c < 127) ? (char) c : '.';
+			}
+			row[pos++] = '|';
+		} else {
+			while (pos > 0 && row[pos - 1] == ' ') pos--;
+		}
+
+		for (const char *eol = DEBUG_EOL; *eol != 0; eol++) {
+			row[pos++] = *eol;
+		}
+
+		dbg_sink_write(row, pos);
+	}
+}
+
 
-	v100_attr(FMT_RESET);
+/** Print a short buffer as a tagged log line */
+void dbg_hexline(const char *label, const void *data, size_t len)
+{
+	// leave room for the label and timestamp added by dbg()
+	char hex[DEBUG_LINE_MAX - 32];
+	hex_format(hex, sizeof(hex), data, len);
+	dbg("%s: %s", label, hex);
 }
 
 
 void v100_attr_(uint8_t count, ...)
 {
+	char buf[24];
+	size_t pos = 0;
+
 	va_list va;
 	va_start(va, count);
 
-	putchar(27);
-	putchar('[');
+	buf[pos++] = 27;
+	buf[pos++] = '[';
 
-	for (int i = 0; i < count; i++) {
+	for (int i = 0; i < count && pos < sizeof(buf) - 5; i++) {
 		int attr = va_arg(va, int);
 
 		// comma
-		if (i > 0) putchar(';');
+		if (i > 0) buf[pos++] = ';';
 
-		// number
-		printf("%d", attr);
+		// number (attributes are < 100)
+		if (attr >= 10) buf[pos++] = (char) ('0' + attr / 10);
+		buf[pos++] = (char) ('0' + attr % 10);
 	}
 
-	putchar('m');
+	buf[pos++] = 'm';
+	buf[pos] = 0;
 
 	va_end(va);
+
+	fputs(buf, stdout);
 }
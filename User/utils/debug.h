@@ -3,6 +3,7 @@
 
 #include <common.h>
 #include <stdarg.h>
+#include "hex.h"
 
 // helper to mark printf functions
 #define PRINTF_LIKE __attribute__((format(printf, 1, 2)))
@@ -14,6 +15,55 @@
 #define DEBUG_TAG_BASE  "[ ] "
 #define DEBUG_TAG_INFO  "[i] "
 
+// Max length of a log line (longer messages are truncated)
+#define DEBUG_LINE_MAX 128
+
+// Size of the stdout buffer (printf, dbg_printf, dbg_raw)
+#define DEBUG_STDOUT_BUF 128
+
+// Number of recent log lines kept in RAM (for crash dumps), 0 to disable
+#define DEBUG_HISTORY 4
+
+// Max length of a line kept in the history
+#define DEBUG_HISTORY_LEN 48
+
+// Debug output sink - 0: USART1, 1: ITM stimulus port (SWO)
+#ifndef DEBUG_USE_ITM
+#define DEBUG_USE_ITM 0
+#endif
+
+/**
+ * @brief Init the debug output.
+ *
+ * Makes stdout fully buffered with a static buffer. Log lines (dbg(), info() ...)
+ * are built in one piece and bypass stdout; printf() output collects in
+ * the buffer until it fills up, a log line is printed or dbg_flush() is called.
+ */
+void debug_init(void);
+
+/** Send buffered printf() output to the debug sink */
+void dbg_flush(void);
+
+/**
+ * @brief Get a recent log line from the history.
+ * @param n : 0 = newest, up to DEBUG_HISTORY-1
+ * @return the line (without colours and line ending), NULL if there's none
+ */
+const char *dbg_history(size_t n);
+
+/**
+ * @brief Send raw bytes to the debug sink (USART1 or ITM).
+ *
+ * This is the transport under stdout/stderr.
+ *
+ * @param buf : data
+ * @param len : data length
+ */
+void dbg_sink_write(const char *buf, size_t len);
+
+/** Get the number of dbg_sink_write() calls so far (transport invocations) */
+uint32_t dbg_sink_count(void);
+
 
 /** Print a log message with no tag and no newline */
 void dbg_printf(const char *fmt, ...) PRINTF_LIKE;
@@ -51,6 +101,46 @@ void warn(const char *fmt, ...) PRINTF_LIKE;
 void error(const char *fmt, ...) PRINTF_LIKE;
 
 
+/** Hexdump options */
+typedef enum {
+	HEXDUMP_ADDR = 1 << 0,  ///< Prefix rows with the address
+	HEXDUMP_ASCII = 1 << 1, ///< Add the ASCII column
+} hexdump_flags_t;
+
+/** Bytes per hexdump row */
+#define HEXDUMP_ROW 16
+
+/**
+ * @brief Dump memory as hex, with addresses and ASCII.
+ * @param addr : start address
+ * @param len  : number of bytes
+ */
+void dbg_hexdump(const void *addr, size_t len);
+
+/**
+ * @brief Dump memory as hex.
+ *
+ * Each row is formatted in one pass and sent with a single sink write.
+ *
+ * @param addr  : start address
+ * @param len   : number of bytes
+ * @param base  : address shown for the first byte (e.g. 0 to show offsets)
+ * @param flags : hexdump_flags_t
+ */
+void dbg_hexdump_ex(const void *addr, size_t len, uint32_t base, uint32_t flags);
+
+/**
+ * @brief Print a short buffer as a tagged log line, e.g. "RX: 01 02 ff".
+ *
+ * Output is truncated to fit DEBUG_LINE_MAX.
+ *
+ * @param label : line label
+ * @param data  : bytes
+ * @param len   : number of bytes
+ */
+void dbg_hexline(const char *label, const void *data, size_t len);
+
+
 /** ANSI formatting attributes */
 typedef enum {
 	// Non-colour Attributes
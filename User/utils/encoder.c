@@ -0,0 +1,171 @@
+#include <common.h>
+#include "encoder.h"
+#include "timhw.h"
+#include "timebase.h"
+
+struct encoder {
+	TIM_TypeDef *tim;
+	uint16_t last_cnt;  ///< counter at the last tick
+	int32_t pos;        ///< position at the last tick
+	int32_t window_pos; ///< position at the start of the window
+	uint16_t window;    ///< window length (ms)
+	uint16_t elapsed;   ///< ms into the window
+	uint8_t smoothing;  ///< IIR shift
+	int32_t vel_acc;    ///< filtered velocity << smoothing
+	int32_t acc_acc;    ///< filtered acceleration << smoothing
+	int32_t velocity;
+	int32_t accel;
+};
+
+static struct encoder encoders[ENCODER_MAX];
+static size_t encoder_count = 0;
+
+static void encoder_task(void *unused);
+
+
+/** Configure the timer and pins and start counting */
+encoder_t *encoder_init(const encoder_init_t *init)
+{
+	if (encoder_count >= ENCODER_MAX) return NULL;
+	if (init->filter > 15) return NULL;
+	if (init->smoothing > 7 && init->smoothing != ENCODER_SMOOTHING_OFF) return NULL;
+	if (!tim_clock_enable(init->tim)) return NULL;
+
+	uint32_t pull = init->pullup ? GPIO_PULLUP : GPIO_NOPULL;
+	tim_pin_init(init->tim, 1, GPIO_MODE_INPUT, pull);
+	tim_pin_init(init->tim, 2, GPIO_MODE_INPUT, pull);
+
+	TIM_HandleTypeDef htim;
+	htim.Instance = init->tim;
+	htim.State = HAL_TIM_STATE_RESET;
+	htim.Lock = HAL_UNLOCKED;
+	htim.Init.Prescaler = 0;
+	htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim.Init.Period = 0xFFFF;
+	htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim.Init.RepetitionCounter = 0;
+
+	TIM_Encoder_InitTypeDef cfg;
+	cfg.EncoderMode = TIM_ENCODERMODE_TI12;
+	cfg.IC1Polarity = init->invert ? TIM_ICPOLARITY_FALLING : TIM_ICPOLARITY_RISING;
+	cfg.IC1Selection = TIM_ICSELECTION_DIRECTTI;
+	cfg.IC1Prescaler = TIM_ICPSC_DIV1;
+	cfg.IC1Filter = init->filter;
+	cfg.IC2Polarity = TIM_ICPOLARITY_RISING;
+	cfg.IC2Selection = TIM_ICSELECTION_DIRECTTI;
+	cfg.IC2Prescaler = TIM_ICPSC_DIV1;
+	cfg.IC2Filter = init->filter;
+
+	if (HAL_TIM_Encoder_Init(&htim, &cfg) != HAL_OK) return NULL;
+	if (HAL_TIM_Encoder_Start(&htim, TIM_CHANNEL_ALL) != HAL_OK) return NULL;
+
+	if (encoder_count == 0) {
+		if (add_periodic_task(encoder_task, NULL, 1, false) == PID_NONE) return NULL;
+	}
+
+	struct encoder *enc = &encoders[encoder_count];
+	enc->tim = init->tim;
+	enc->last_cnt = (uint16_t) init->tim->CNT;
+	enc->pos = 0;
+	enc->window_pos = 0;
+	enc->window = init->window ? init->window : ENCODER_WINDOW;
+	enc->elapsed = 0;
+	if (init->smoothing == ENCODER_SMOOTHING_OFF) {
+		enc->smoothing = 0; // y = x
+	} else {
+		enc->smoothing = init->smoothing ? init->smoothing : ENCODER_SMOOTHING;
+	}
+	enc->vel_acc = 0;
+	enc->acc_acc = 0;
+	enc->velocity = 0;
+	enc->accel = 0;
+
+	// the tick only looks at registered encoders
+	__DMB();
+	encoder_count++;
+
+	return enc;
+}
+
+
+/** Get the position, including steps since the last tick */
+int32_t encoder_position(encoder_t *enc)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	int32_t pos = enc->pos + (int16_t) ((uint16_t) enc->tim->CNT - enc->last_cnt);
+
+	__set_PRIMASK(primask);
+
+	return pos;
+}
+
+
+/** Set the position */
+void encoder_set_position(encoder_t *enc, int32_t pos)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	// take in the steps since the last tick, so the tick doesn't add them again
+	uint16_t cnt = (uint16_t) enc->tim->CNT;
+	int32_t now = enc->pos + (int16_t) (cnt - enc->last_cnt);
+	enc->last_cnt = cnt;
+
+	// shift the window too, so the jump doesn't show up as velocity
+	enc->window_pos += pos - now;
+	enc->pos = pos;
+
+	__set_PRIMASK(primask);
+}
+
+
+/** Get the velocity */
+int32_t encoder_velocity(encoder_t *enc)
+{
+	return enc->velocity;
+}
+
+
+/** Get the acceleration */
+int32_t encoder_acceleration(encoder_t *enc)
+{
+	return enc->accel;
+}
+
+
+/** Extend the counter and update the estimates */
+static void encoder_update(struct encoder *enc)
+{
+	uint16_t cnt = (uint16_t) enc->tim->CNT;
+	enc->pos += (int16_t) (cnt - enc->last_cnt);
+	enc->last_cnt = cnt;
+
+	if (++enc->elapsed < enc->window) return;
+
+	int32_t raw_vel = (enc->pos - enc->window_pos) * 1000 / enc->window;
+	enc->window_pos = enc->pos;
+	enc->elapsed = 0;
+
+	// y += x - y/2^n, kept scaled by 2^n so small changes aren't lost
+	enc->vel_acc += raw_vel - (enc->vel_acc >> enc->smoothing);
+	int32_t vel = enc->vel_acc >> enc->smoothing;
+
+	int32_t raw_acc = (vel - enc->velocity) * 1000 / enc->window;
+	enc->acc_acc += raw_acc - (enc->acc_acc >> enc->smoothing);
+
+	enc->velocity = vel;
+	enc->accel = enc->acc_acc >> enc->smoothing;
+}
+
+
+/** Runs every ms */
+static void encoder_task(void *unused)
+{
+	UNUSED(unused);
+
+	for (size_t i = 0; i < encoder_count; i++) {
+		encoder_update(&encoders[i]);
+	}
+}
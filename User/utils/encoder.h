@@ -0,0 +1,60 @@
+#ifndef MPORK_ENCODER_H
+#define MPORK_ENCODER_H
+
+/**
+ * Quadrature encoder on a timer's encoder interface.
+ *
+ * The timer counts both edges of both channels (x4) in hardware, so no
+ * CPU time is spent per step. The timebase tick extends the 16-bit counter
+ * to a 32-bit position (up to 32767 counts per ms) and estimates
+ * velocity and acceleration from the position change over a window,
+ * smoothed with a first-order IIR filter.
+ *
+ * Inputs are CH1 and CH2 of the timer (see timhw.h).
+ * Requires timebase, uses one periodic task.
+ */
+
+#include <common.h>
+
+/** Max number of encoders (one per timer) */
+#define ENCODER_MAX 3
+
+/** Default velocity window (ms) */
+#define ENCODER_WINDOW 10
+
+/** Default IIR smoothing (filter weight 1/2^n) */
+#define ENCODER_SMOOTHING 2
+
+/** Value of encoder_init_t.smoothing that disables the IIR filter */
+#define ENCODER_SMOOTHING_OFF 0xFF
+
+typedef struct {
+	TIM_TypeDef *tim;  ///< timer with CH1/CH2 inputs
+	uint8_t filter;    ///< input filter 0-15 (see TIMx_CCMR1 ICxF), 0 = none
+	bool invert;       ///< count the other way
+	bool pullup;       ///< enable pull-ups (mechanical encoders to ground)
+	uint16_t window;   ///< velocity window (ms), 0 = default
+	uint8_t smoothing; ///< IIR smoothing 1-7, 0 = default, ENCODER_SMOOTHING_OFF = none; higher is smoother but slower
+} encoder_init_t;
+
+typedef struct encoder encoder_t;
+
+/**
+ * @brief Configure the timer and pins and start counting.
+ * @return the encoder, NULL on failure
+ */
+encoder_t *encoder_init(const encoder_init_t *init);
+
+/** Get the position (counts, x4) */
+int32_t encoder_position(encoder_t *enc);
+
+/** Set the position. Velocity and acceleration are not affected. */
+void encoder_set_position(encoder_t *enc, int32_t pos);
+
+/** Get the velocity (counts/s), updated every window */
+int32_t encoder_velocity(encoder_t *enc);
+
+/** Get the acceleration (counts/s^2), updated every window */
+int32_t encoder_acceleration(encoder_t *enc);
+
+#endif //MPORK_ENCODER_H
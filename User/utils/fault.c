@@ -0,0 +1,273 @@
+#include <common.h>
+#include "fault.h"
+
+#if FAULT_CRASHDUMP
+#include "crashdump.h"
+#endif
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// CFSR address valid flags
+#define CFSR_MMARVALID (1UL << 7)
+#define CFSR_BFARVALID (1UL << 15)
+
+// polls of TXE before giving up on a character (UART dead or not initialized)
+#define FAULT_TX_SPIN 100000
+
+void fault_panic_report(const char *msg, uint32_t caller, uint32_t sp) __attribute__((noreturn, used));
+
+/** Reserved stack for the fault reporter */
+uint8_t fault_stack[FAULT_STACK_SIZE] __attribute__((aligned(8), used));
+
+/** Linker symbols */
+extern uint32_t _etext;
+extern uint32_t _sramfunc;
+extern uint32_t _eramfunc;
+extern uint32_t _estack;
+
+typedef struct {
+	uint8_t bit;
+	const char *name;
+} fault_bit_t;
+
+static const fault_bit_t cfsr_bits[] = {
+	{0, "IACCVIOL"},
+	{1, "DACCVIOL"},
+	{3, "MUNSTKERR"},
+	{4, "MSTKERR"},
+	{7, "MMARVALID"},
+	{8, "IBUSERR"},
+	{9, "PRECISERR"},
+	{10, "IMPRECISERR"},
+	{11, "UNSTKERR"},
+	{12, "STKERR"},
+	{15, "BFARVALID"},
+	{16, "UNDEFINSTR"},
+	{17, "INVSTATE"},
+	{18, "INVPC"},
+	{19, "NOCP"},
+	{24, "UNALIGNED"},
+	{25, "DIVBYZERO"},
+};
+
+static const fault_bit_t hfsr_bits[] = {
+	{1, "VECTTBL"},
+	{30, "FORCED"},
+	{31, "DEBUGEVT"},
+};
+
+
+/** Switch to the fault stack and jump to fault_report() */
+void fault_entry(void)
+{
+	__asm volatile (
+		" tst lr, #4                      \n"
+		" ite eq                          \n"
+		" mrseq r0, msp                   \n"
+		" mrsne r0, psp                   \n"
+		" mov r1, lr                      \n"
+		" mrs r2, ipsr                    \n"
+		" ldr r3, =fault_stack            \n"
+		" addw r3, r3, #" STR(FAULT_STACK_SIZE) "\n"
+		" mov sp, r3                      \n"
+		" b fault_report                  \n"
+	);
+}
+
+
+// region Polled output
+
+static void fault_putc(char c)
+{
+	if ((USART1->CR1 & USART_CR1_UE) == 0) return; // UART not running
+
+	for (uint32_t i = 0; i < FAULT_TX_SPIN; i++) {
+		if (USART1->SR & USART_SR_TXE) {
+			USART1->DR = (uint8_t) c;
+			return;
+		}
+	}
+}
+
+static void fault_puts(const char *s)
+{
+	while (*s != 0) fault_putc(*s++);
+}
+
+static void fault_puthex(uint32_t v)
+{
+	static const char digits[16] = "0123456789abcdef";
+
+	fault_puts("0x");
+	for (int shift = 28; shift >= 0; shift -= 4) {
+		fault_putc(digits[(v >> shift) & 0x0F]);
+	}
+}
+
+static void fault_putreg(const char *name, uint32_t v)
+{
+	fault_puts(name);
+	fault_puts(" = ");
+	fault_puthex(v);
+	fault_puts("\r\n");
+}
+
+static void fault_putbits(uint32_t v, const fault_bit_t *bits, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (v & (1UL << bits[i].bit)) {
+			fault_putc(' ');
+			fault_puts(bits[i].name);
+		}
+	}
+	fault_puts("\r\n");
+}
+
+// endregion
+
+
+/** Flush the output, then stop at a breakpoint or reset */
+static void __attribute__((noreturn)) fault_halt(void)
+{
+	// wait for the last byte to leave
+	for (uint32_t i = 0; i < FAULT_TX_SPIN && !(USART1->SR & USART_SR_TC); i++);
+
+	if (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) {
+		__BKPT(0); // debugger attached - stop here
+	}
+
+	NVIC_SystemReset();
+	while (1);
+}
+
+
+/** Check if a word looks like a Thumb return address in our code */
+static bool is_return_address(uint32_t w)
+{
+	if ((w & 1) == 0) return false;
+
+	uint32_t addr = w & ~1UL;
+	bool in_flash = addr >= FLASH_BASE + 4 && addr <= (uint32_t) &_etext;
+	bool in_ramfunc = addr >= (uint32_t) &_sramfunc + 4 && addr <= (uint32_t) &_eramfunc;
+	if (!in_flash && !in_ramfunc) return false;
+
+	// preceded by BL (32-bit) or BLX Rm (16-bit)?
+	uint16_t hw1 = *(uint16_t *) (addr - 4);
+	uint16_t hw2 = *(uint16_t *) (addr - 2);
+
+	if ((hw1 & 0xF800) == 0xF000 && (hw2 & 0xD000) == 0xD000) return true;
+	if ((hw2 & 0xFF87) == 0x4780) return true;
+
+	return false;
+}
+
+
+/** Print a fault report and reset */
+void fault_report(uint32_t *frame, uint32_t exc_return, uint32_t ipsr)
+{
+	static const char *const names[] = {
+		"Hard fault", "Memory management fault", "Bus fault", "Usage fault"
+	};
+
+	fault_puts("\r\n\r\n*** ");
+	fault_puts((ipsr >= 3 && ipsr <= 6) ? names[ipsr - 3] : "Fault");
+	fault_puts(" ***\r\n");
+
+	const uint32_t ram_end = (uint32_t) &_estack;
+	const bool frame_ok = ((uint32_t) frame >= SRAM_BASE)
+						  && ((uint32_t) frame + 32 <= ram_end)
+						  && (((uint32_t) frame & 3) == 0);
+
+#if FAULT_CRASHDUMP
+	if (crashdump_save(frame_ok ? frame : NULL, exc_return, ipsr)) {
+		fault_puts("Crash dump saved.\r\n");
+	}
+#endif
+
+	if (frame_ok) {
+		fault_putreg("R0  ", frame[0]);
+		fault_putreg("R1  ", frame[1]);
+		fault_putreg("R2  ", frame[2]);
+		fault_putreg("R3  ", frame[3]);
+		fault_putreg("R12 ", frame[4]);
+		fault_putreg("LR  ", frame[5]);
+		fault_putreg("PC  ", frame[6]);
+		fault_putreg("PSR ", frame[7]);
+	} else {
+		fault_puts("Stack pointer invalid, no frame\r\n");
+	}
+
+	fault_putreg("SP  ", (uint32_t) frame);
+	fault_putreg("EXC ", exc_return);
+
+	uint32_t cfsr = SCB->CFSR;
+	uint32_t hfsr = SCB->HFSR;
+
+	fault_puts("CFSR = ");
+	fault_puthex(cfsr);
+	fault_putbits(cfsr, cfsr_bits, sizeof(cfsr_bits) / sizeof(cfsr_bits[0]));
+
+	fault_puts("HFSR = ");
+	fault_puthex(hfsr);
+	fault_putbits(hfsr, hfsr_bits, sizeof(hfsr_bits) / sizeof(hfsr_bits[0]));
+
+	if (cfsr & CFSR_MMARVALID) fault_putreg("MMFAR", SCB->MMFAR);
+	if (cfsr & CFSR_BFARVALID) fault_putreg("BFAR ", SCB->BFAR);
+
+	if (frame_ok) {
+		fault_puts("Backtrace:");
+
+		// skip the basic frame and the alignment padding word
+		uint32_t *sp = frame + 8;
+		if (frame[7] & (1UL << 9)) sp++;
+
+		int found = 0;
+		for (int i = 0; i < FAULT_BACKTRACE_SCAN && found < FAULT_BACKTRACE_DEPTH; i++, sp++) {
+			if ((uint32_t) sp >= ram_end) break;
+			if (!is_return_address(*sp)) continue;
+
+			fault_putc(' ');
+			fault_puthex(*sp & ~1UL);
+			found++;
+		}
+		fault_puts("\r\n");
+	}
+
+	fault_halt();
+}
+
+
+/** Switch to the fault stack and jump to fault_panic_report() */
+void fault_panic(const char *msg)
+{
+	__asm volatile (
+		" cpsid i                         \n"
+		" mov r1, lr                      \n"
+		" mov r2, sp                      \n"
+		" ldr r3, =fault_stack            \n"
+		" addw r3, r3, #" STR(FAULT_STACK_SIZE) "\n"
+		" mov sp, r3                      \n"
+		" b fault_panic_report            \n"
+	);
+}
+
+
+/** Report a panic and reset. Runs on the fault stack. */
+void fault_panic_report(const char *msg, uint32_t caller, uint32_t sp)
+{
+	fault_puts("\r\n\r\n*** Panic: ");
+	fault_puts(msg);
+	fault_puts(" ***\r\n");
+
+	fault_putreg("LR  ", caller);
+	fault_putreg("SP  ", sp);
+
+#if FAULT_CRASHDUMP
+	if (crashdump_save(NULL, 0, __get_IPSR())) {
+		fault_puts("Crash dump saved.\r\n");
+	}
+#endif
+
+	fault_halt();
+}
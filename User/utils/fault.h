@@ -0,0 +1,59 @@
+#ifndef MPORK_FAULT_H
+#define MPORK_FAULT_H
+
+/**
+ * Fault reporter.
+ *
+ * The fault handlers branch to fault_entry(), which switches to a reserved
+ * stack and prints the stacked registers, decoded fault status registers
+ * and a heuristic backtrace by writing directly to the USART1 data register.
+ * Nothing here uses printf, the heap or the faulting stack.
+ *
+ * With FAULT_CRASHDUMP, the report is also saved to flash (see crashdump.h).
+ *
+ * Afterwards the MCU is reset, or halted at a breakpoint if a debugger is attached.
+ */
+
+#include <common.h>
+
+/** Save a crash record to flash */
+#define FAULT_CRASHDUMP 1
+
+/** Size of the reserved fault stack (bytes) */
+#define FAULT_STACK_SIZE 512
+
+/** Max number of backtrace entries printed */
+#define FAULT_BACKTRACE_DEPTH 12
+
+/** Max number of stack words scanned for the backtrace */
+#define FAULT_BACKTRACE_SCAN 256
+
+/**
+ * @brief Fault handler entry point.
+ *
+ * Must be jumped to (not called) as the first instruction of a fault handler,
+ * with LR still holding the EXC_RETURN value.
+ */
+void fault_entry(void) __attribute__((naked, noreturn));
+
+/**
+ * @brief Print a fault report and reset. Runs on the fault stack.
+ * @param frame      : exception stack frame (r0-r3, r12, lr, pc, xpsr)
+ * @param exc_return : EXC_RETURN value from the handler's LR
+ * @param ipsr       : active exception number
+ */
+void fault_report(uint32_t *frame, uint32_t exc_return, uint32_t ipsr) __attribute__((noreturn, used));
+
+/**
+ * @brief Report a fatal software error and reset.
+ *
+ * For conditions where the system state can't be trusted (e.g. a stack
+ * overflow). Switches to the fault stack, prints the message with polled
+ * output, saves a crash record without an exception frame, then resets
+ * like a fault.
+ *
+ * @param msg : message to print
+ */
+void fault_panic(const char *msg) __attribute__((naked, noreturn));
+
+#endif //MPORK_FAULT_H
@@ -0,0 +1,23 @@
+#include "hex.h"
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+
+/** Format bytes as space-separated hex */
+size_t hex_format(char *dst, size_t cap, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t pos = 0;
+
+	if (cap == 0) return 0;
+
+	// 2 chars for the first byte, 3 for the others, and the terminator
+	for (size_t i = 0; i < len && pos + (i ? 3 : 2) < cap; i++) {
+		if (i > 0) dst[pos++] = ' ';
+		dst[pos++] = hex_digits[p[i] >> 4];
+		dst[pos++] = hex_digits[p[i] & 0x0F];
+	}
+
+	dst[pos] = 0;
+	return pos;
+}
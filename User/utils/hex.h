@@ -0,0 +1,28 @@
+#ifndef MPORK_HEX_H
+#define MPORK_HEX_H
+
+/**
+ * Hex formatting helpers.
+ *
+ * No HAL dependencies, so they can be built and tested on the host
+ * (tools/tests).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Format bytes as space-separated hex.
+ *
+ * Stops at the last byte that fits, the output is always terminated
+ * (if cap > 0).
+ *
+ * @param dst  : output buffer (3 chars per byte are needed)
+ * @param cap  : output buffer size, incl. terminator
+ * @param data : bytes
+ * @param len  : number of bytes
+ * @return number of characters written (excl. terminator)
+ */
+size_t hex_format(char *dst, size_t cap, const void *data, size_t len);
+
+#endif //MPORK_HEX_H
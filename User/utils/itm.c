@@ -0,0 +1,110 @@
+#include <common.h>
+#include "itm.h"
+#include "clock.h"
+
+// Number of FIFO polls before giving up on a write
+#define ITM_RETRY 32
+
+/** Bytes dropped due to a full FIFO */
+static volatile uint32_t itm_drop_count = 0;
+
+/** SWO baud rate, kept for clock changes */
+static uint32_t itm_swo_baud;
+
+
+/** Update the SWO prescaler after a clock change */
+static void itm_retime(uint32_t hclk)
+{
+	TPI->ACPR = (hclk / itm_swo_baud) - 1;
+}
+
+
+/** Enable the ITM and SWO output */
+void itm_init(uint32_t swo_baud)
+{
+	// HAL_MspInit() disables SWJ completely; keep SW-DP and TRACESWO (PB3), drop only JTAG
+	__HAL_RCC_AFIO_CLK_ENABLE();
+	__HAL_AFIO_REMAP_SWJ_NOJTAG();
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+	// Asynchronous trace on the SWO pin
+	DBGMCU->CR = (DBGMCU->CR & ~DBGMCU_CR_TRACE_MODE) | DBGMCU_CR_TRACE_IOEN;
+
+	TPI->SPPR = 2; // NRZ (UART-like) encoding
+	itm_swo_baud = swo_baud;
+	itm_retime(SystemCoreClock);
+	clock_add_listener(itm_retime);
+	TPI->FFCR = TPI_FFCR_TrigIn_Msk; // formatter bypassed
+
+	ITM->LAR = 0xC5ACCE55; // unlock
+	ITM->TCR = (1UL << ITM_TCR_TraceBusID_Pos) | ITM_TCR_ITMENA_Msk;
+	ITM->TPR = 0; // all ports accessible unprivileged
+	ITM->TER = ITM_CH_MASK;
+}
+
+
+/** Wait a little for the FIFO to become ready. Returns false if still full. */
+static inline bool itm_wait_ready(itm_channel_t ch)
+{
+	for (int i = 0; i < ITM_RETRY; i++) {
+		if (ITM->PORT[ch].u32 != 0) return true;
+	}
+
+	return false;
+}
+
+
+/** Write a buffer to a stimulus port */
+size_t itm_write(itm_channel_t ch, const void *buf, size_t len)
+{
+	if (!itm_enabled(ch)) return 0;
+
+	const uint8_t *p = buf;
+	size_t done = 0;
+
+	// Full words are sent as 4-byte packets, which halves the protocol overhead
+	while (len - done >= 4) {
+		if (!itm_wait_ready(ch)) goto drop;
+
+		ITM->PORT[ch].u32 = (uint32_t) p[done]
+							| ((uint32_t) p[done + 1] << 8)
+							| ((uint32_t) p[done + 2] << 16)
+							| ((uint32_t) p[done + 3] << 24);
+		done += 4;
+	}
+
+	while (done < len) {
+		if (!itm_wait_ready(ch)) goto drop;
+
+		ITM->PORT[ch].u8 = p[done++];
+	}
+
+	return done;
+
+drop:
+	itm_drop_count += len - done;
+	return done;
+}
+
+
+/** Send a 32-bit event word */
+bool itm_event(itm_channel_t ch, uint32_t value)
+{
+	if (!itm_enabled(ch)) return false;
+
+	if (!itm_wait_ready(ch)) {
+		itm_drop_count += 4;
+		return false;
+	}
+
+	ITM->PORT[ch].u32 = value;
+	return true;
+}
+
+
+/** Get the number of dropped bytes */
+uint32_t itm_dropped(void)
+{
+	return itm_drop_count;
+}
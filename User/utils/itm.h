@@ -0,0 +1,73 @@
+#ifndef MPORK_ITM_H
+#define MPORK_ITM_H
+
+/**
+ * ITM / SWO trace output.
+ *
+ * Data written to the ITM stimulus ports is sent out through the SWO pin
+ * (PB3) and must be captured by a trace-capable probe (ST-Link V2-1, J-Link...).
+ * Decode the recorded byte stream with tools/swo_decode.py.
+ *
+ * All writes are non-blocking: if the ITM FIFO is full, the data is dropped
+ * and counted in itm_dropped().
+ */
+
+#include <common.h>
+
+/** Stimulus port assignment */
+typedef enum {
+	ITM_CH_LOG = 0,     ///< Text log (debug module output)
+	ITM_CH_PROFILE = 1, ///< Profiling events (32-bit words)
+	ITM_CH_TASK = 2,    ///< Task switches (32-bit task PIDs)
+} itm_channel_t;
+
+/** Mask of the stimulus ports enabled by itm_init() */
+#define ITM_CH_MASK ((1 << ITM_CH_LOG) | (1 << ITM_CH_PROFILE) | (1 << ITM_CH_TASK))
+
+/** Default SWO bitrate */
+#define ITM_SWO_BAUD 2000000
+
+/**
+ * @brief Enable the ITM and set up the SWO output.
+ *
+ * Normally the debug probe configures the trace unit, calling this
+ * lets the firmware start tracing even before the probe attaches.
+ *
+ * Also re-enables SW-DP and the SWO pin, which HAL_MspInit() turns off
+ * (JTAG stays disabled, freeing PA15, PB4).
+ *
+ * @param swo_baud : SWO bitrate (the probe must be set to match)
+ */
+void itm_init(uint32_t swo_baud);
+
+/**
+ * @brief Check if a stimulus port is enabled and tracing is on.
+ * @param ch : channel
+ * @return true if writes to the port will be transmitted
+ */
+static inline bool itm_enabled(itm_channel_t ch)
+{
+	return (ITM->TCR & ITM_TCR_ITMENA_Msk) && (ITM->TER & (1UL << ch));
+}
+
+/**
+ * @brief Write a buffer to a stimulus port.
+ * @param ch  : channel
+ * @param buf : data
+ * @param len : data length
+ * @return number of bytes actually written (the rest was dropped)
+ */
+size_t itm_write(itm_channel_t ch, const void *buf, size_t len);
+
+/**
+ * @brief Send a 32-bit event word (profiling mark, task PID...)
+ * @param ch    : channel
+ * @param value : event value
+ * @return true if sent, false if dropped
+ */
+bool itm_event(itm_channel_t ch, uint32_t value);
+
+/** Get the number of bytes dropped due to a full FIFO */
+uint32_t itm_dropped(void);
+
+#endif //MPORK_ITM_H
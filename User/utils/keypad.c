@@ -0,0 +1,149 @@
+#include <common.h>
+#include "keypad.h"
+#include "timebase.h"
+
+static keypad_init_t kp;
+
+/** Row being scanned (driven low) */
+static uint8_t kp_row = 0;
+
+/** Debounced state, one bit per column */
+static uint8_t kp_state[KEYPAD_ROWS_MAX];
+
+/** Vertical counters */
+static uint8_t kp_ct0[KEYPAD_ROWS_MAX];
+static uint8_t kp_ct1[KEYPAD_ROWS_MAX];
+
+static void keypad_task(void *unused);
+
+
+/** Dispatch hook - run the user callback in the main loop */
+static void keypad_ext_handler(const debo_event_t *ev)
+{
+	if (kp.callback == NULL) return;
+	if (ev->type != DEBO_EV_PRESS && ev->type != DEBO_EV_RELEASE) return;
+
+	kp.callback(ev->id & 0xFF, ev->type == DEBO_EV_PRESS);
+}
+
+
+/** Configure the pins and start scanning */
+bool keypad_init(const keypad_init_t *init)
+{
+	if (init->row_count == 0 || init->row_count > KEYPAD_ROWS_MAX) return false;
+	if (init->col_count == 0 || init->col_count > KEYPAD_COLS_MAX) return false;
+
+	kp = *init;
+
+	GPIO_InitTypeDef gpio;
+	gpio.Speed = GPIO_SPEED_FREQ_LOW;
+
+	gpio.Mode = GPIO_MODE_OUTPUT_OD;
+	gpio.Pull = GPIO_NOPULL;
+	for (size_t r = 0; r < kp.row_count; r++) {
+		kp.rows[r].port->BSRR = kp.rows[r].pin; // released
+		gpio.Pin = kp.rows[r].pin;
+		HAL_GPIO_Init(kp.rows[r].port, &gpio);
+	}
+
+	gpio.Mode = GPIO_MODE_INPUT;
+	gpio.Pull = GPIO_PULLUP;
+	for (size_t c = 0; c < kp.col_count; c++) {
+		gpio.Pin = kp.cols[c].pin;
+		HAL_GPIO_Init(kp.cols[c].port, &gpio);
+	}
+
+	kp_row = 0;
+	kp.rows[0].port->BRR = kp.rows[0].pin;
+
+	debo_set_ext_handler(keypad_ext_handler);
+
+	return add_periodic_task(keypad_task, NULL, 1, false) != PID_NONE;
+}
+
+
+/** Check if a key is pressed */
+bool keypad_key_state(uint32_t key)
+{
+	uint32_t r = key / kp.col_count;
+	uint32_t c = key % kp.col_count;
+	if (r >= kp.row_count) return false;
+
+	return (kp_state[r] >> c) & 1;
+}
+
+
+/** Read the columns of the selected row, 1 = pressed */
+static uint8_t read_cols(void)
+{
+	uint8_t raw = 0;
+
+	for (size_t c = 0; c < kp.col_count; c++) {
+		if (!(kp.cols[c].port->IDR & kp.cols[c].pin)) raw |= (uint8_t) (1 << c);
+	}
+
+	return raw;
+}
+
+
+/**
+ * Find new presses in a row that could be ghosts: the key completes
+ * a rectangle with three pressed keys (another row sharing two columns).
+ */
+static uint8_t ghost_mask(uint8_t row, uint8_t pressing)
+{
+	uint8_t ghosts = 0;
+
+	for (uint8_t r = 0; r < kp.row_count; r++) {
+		if (r == row) continue;
+
+		uint8_t both = kp_state[r] & (kp_state[row] | pressing);
+		// two shared columns - any new press among them is ambiguous
+		if (both & (both - 1)) ghosts |= pressing & both;
+	}
+
+	return ghosts;
+}
+
+
+/** Post events for changed keys of a row */
+static void report(uint8_t row, uint8_t changed)
+{
+	for (uint8_t c = 0; c < kp.col_count; c++) {
+		if (!(changed & (1 << c))) continue;
+
+		bool press = (kp_state[row] >> c) & 1;
+		debo_post_event(row * kp.col_count + c, press ? DEBO_EV_PRESS : DEBO_EV_RELEASE, 0);
+	}
+}
+
+
+/** Scan one row per tick */
+static void keypad_task(void *unused)
+{
+	UNUSED(unused);
+
+	uint8_t row = kp_row;
+	uint8_t raw = read_cols();
+
+	// 2-bit vertical counter: a bit flips after 4 samples different from the state
+	uint8_t delta = raw ^ kp_state[row];
+	kp_ct0[row] = (uint8_t) ~(kp_ct0[row] & delta);
+	kp_ct1[row] = kp_ct0[row] ^ (kp_ct1[row] & delta);
+	uint8_t changed = delta & kp_ct0[row] & kp_ct1[row];
+
+	if (!kp.diodes) {
+		// hold back possible ghosts (their counters start over)
+		changed &= ~ghost_mask(row, changed & raw);
+	}
+
+	if (changed) {
+		kp_state[row] ^= changed;
+		report(row, changed);
+	}
+
+	// select the next row, it settles until the next tick
+	kp.rows[row].port->BSRR = kp.rows[row].pin;
+	kp_row = (uint8_t) ((row + 1) % kp.row_count);
+	kp.rows[kp_row].port->BRR = kp.rows[kp_row].pin;
+}
@@ -0,0 +1,62 @@
+#ifndef MPORK_KEYPAD_H
+#define MPORK_KEYPAD_H
+
+/**
+ * Matrix keypad scanner.
+ *
+ * Rows are open-drain outputs, driven low one at a time; columns are
+ * inputs with pull-ups. One row is read per ms (timebase task), so the
+ * columns settle for a full tick after switching rows.
+ *
+ * Each row is debounced bit-parallel with a 2-bit vertical counter:
+ * a key changes state after 4 equal samples of its row (4 x rows ms).
+ *
+ * Without diodes, a key that completes a rectangle of pressed keys may be
+ * a ghost; such presses are blocked until the rectangle is broken.
+ *
+ * Key events go through the debouncer's event queue (DEBO_EXT_FLAG | key)
+ * and are dispatched from the main loop by debo_dispatch(), like pin events.
+ *
+ * Requires timebase and debounce.
+ */
+
+#include <common.h>
+#include "debounce.h"
+
+#define KEYPAD_ROWS_MAX 4
+#define KEYPAD_COLS_MAX 8
+
+/** A GPIO pin */
+typedef struct {
+	GPIO_TypeDef *port;
+	uint16_t pin; ///< pin mask
+} keypad_pin_t;
+
+typedef struct {
+	keypad_pin_t rows[KEYPAD_ROWS_MAX]; ///< driven low to select
+	keypad_pin_t cols[KEYPAD_COLS_MAX]; ///< read, low = pressed
+	uint8_t row_count;
+	uint8_t col_count;
+	bool diodes;      ///< keys have diodes - n-key rollover, no ghost blocking
+	void (*callback)(uint32_t key, bool press); ///< key = row * col_count + col, run by debo_dispatch()
+} keypad_init_t;
+
+/**
+ * @brief Configure the pins and start scanning.
+ *
+ * The GPIO port clocks must be enabled.
+ *
+ * @return success
+ */
+bool keypad_init(const keypad_init_t *init);
+
+/** Check if a key is pressed (debounced) */
+bool keypad_key_state(uint32_t key);
+
+/** Check if an event ID comes from the keypad; the key number is the low byte */
+static inline bool keypad_is_key_event(debo_id_t id)
+{
+	return (id & DEBO_EXT_FLAG) != 0;
+}
+
+#endif //MPORK_KEYPAD_H
@@ -1,7 +1,31 @@
 #include <common.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "handlers.h"
 #include "malloc_safe.h"
+#include "debug.h"
+
+#if MALLOC_TRACK
+
+/** Prepended to each tracked block */
+typedef struct {
+	uint16_t site; ///< index into malloc_sites, or MALLOC_TRACK_SITES if the table was full
+	uint16_t magic;
+	uint32_t size;
+} block_header_t;
+
+#define BLOCK_MAGIC 0xA10C
+
+_Static_assert(sizeof(block_header_t) == MALLOC_TRACK_HEADER, "Block header size");
+
+static malloc_site_t malloc_sites[MALLOC_TRACK_SITES];
+
+/** Allocations whose site didn't fit in the table */
+static malloc_site_t malloc_untracked;
+
+#endif
 
 static void reset_when_done(void)
 {
@@ -11,27 +35,178 @@ static void reset_when_done(void)
 }
 
 
+#if MALLOC_TRACK
+
+/** Find or add a call site record, returns its index */
+static uint16_t site_index(const char *file, uint32_t line)
+{
+	for (uint16_t i = 0; i < MALLOC_TRACK_SITES; i++) {
+		malloc_site_t *site = &malloc_sites[i];
+
+		if (site->file == NULL) {
+			site->file = file;
+			site->line = line;
+			return i;
+		}
+
+		// __FILE__ strings may or may not be merged, compare the text
+		if (site->line == line && (site->file == file || strcmp(site->file, file) == 0)) {
+			return i;
+		}
+	}
+
+	return MALLOC_TRACK_SITES;
+}
+
+
+static inline malloc_site_t *site_at(uint16_t i)
+{
+	return (i < MALLOC_TRACK_SITES) ? &malloc_sites[i] : &malloc_untracked;
+}
+
+
+/** Fill in the header of a new block and return the user pointer */
+static void *track_alloc(void *mem, size_t size, const char *file, uint32_t line)
+{
+	block_header_t *hdr = mem;
+	hdr->site = site_index(file, line);
+	hdr->magic = BLOCK_MAGIC;
+	hdr->size = size;
+
+	malloc_site_t *site = site_at(hdr->site);
+	site->count++;
+	site->total++;
+	site->bytes += size;
+	if (site->bytes > site->peak) site->peak = site->bytes;
+
+	return hdr + 1;
+}
+
+#endif
+
+
 void *malloc_safe_do(size_t size, const char* file, uint32_t line)
 {
+#if MALLOC_TRACK
+	void *mem = malloc(size + MALLOC_TRACK_HEADER);
+#else
 	void *mem = malloc(size);
+#endif
 	if (mem == NULL) {
 		// malloc failed
 		user_error_file_line("Malloc failed", file, line);
 		reset_when_done();
 	}
 
+#if MALLOC_TRACK
+	mem = track_alloc(mem, size, file, line);
+#endif
+
 	return mem;
 }
 
 
 void *calloc_safe_do(size_t nmemb, size_t size, const char* file, uint32_t line)
 {
+#if MALLOC_TRACK
+	// the header is cleared too, doesn't matter
+	size_t total = nmemb * size;
+	void *mem = (size == 0 || total / size == nmemb) ? calloc(1, total + MALLOC_TRACK_HEADER) : NULL;
+#else
 	void *mem = calloc(nmemb, size);
+#endif
 	if (mem == NULL) {
 		// malloc failed
 		user_error_file_line("Calloc failed", file, line);
 		reset_when_done();
 	}
 
+#if MALLOC_TRACK
+	mem = track_alloc(mem, total, file, line);
+#endif
+
 	return mem;
 }
+
+
+void free_safe_do(void *ptr)
+{
+	if (ptr == NULL) return;
+
+#if MALLOC_TRACK
+	block_header_t *hdr = (block_header_t *) ptr - 1;
+	if (hdr->magic != BLOCK_MAGIC) {
+		error("free_s() of a block not from malloc_s() / calloc_s(), or a double free: %p", ptr);
+		return;
+	}
+
+	malloc_site_t *site = site_at(hdr->site);
+	site->count--;
+	site->bytes -= hdr->size;
+
+	hdr->magic = 0;
+	ptr = hdr;
+#endif
+
+	free(ptr);
+}
+
+
+/** Get heap statistics */
+void malloc_get_stats(malloc_stats_t *stats)
+{
+	struct mallinfo mi = mallinfo();
+
+	stats->arena = (uint32_t) mi.arena;
+	stats->used = (uint32_t) mi.uordblks;
+	stats->free = (uint32_t) mi.fordblks;
+	stats->free_chunks = (uint32_t) mi.ordblks;
+	stats->top_free = (uint32_t) mi.keepcost;
+	stats->brk = (uint32_t) sbrk(0);
+	stats->sp = __get_MSP();
+}
+
+
+/** Get a call site record */
+const malloc_site_t *malloc_track_site(size_t n)
+{
+#if MALLOC_TRACK
+	if (n < MALLOC_TRACK_SITES && malloc_sites[n].file != NULL) {
+		return &malloc_sites[n];
+	}
+#endif
+
+	return NULL;
+}
+
+
+/** Print heap statistics and the call site table */
+void malloc_track_dump(void)
+{
+	malloc_stats_t st;
+	malloc_get_stats(&st);
+
+	// free space in holes between allocations - can't be used for big blocks
+	uint32_t holes = st.free - st.top_free;
+
+	info("Heap: %"PRIu32" B from sbrk, %"PRIu32" used, %"PRIu32" free in %"PRIu32" chunks (%"PRIu32" in holes)",
+		 st.arena, st.used, st.free, st.free_chunks, holes);
+	dbg("brk 0x%08"PRIx32", sp 0x%08"PRIx32", %"PRIu32" B between",
+		st.brk, st.sp, st.sp - st.brk);
+
+#if MALLOC_TRACK
+	dbg("Live allocations by call site:");
+	for (size_t i = 0; i < MALLOC_TRACK_SITES; i++) {
+		const malloc_site_t *site = &malloc_sites[i];
+		if (site->file == NULL) break;
+
+		dbg("%s:%"PRIu32" - %d live (%d total), %"PRIu32" B, peak %"PRIu32" B",
+			site->file, site->line, site->count, site->total, site->bytes, site->peak);
+	}
+
+	if (malloc_untracked.total > 0) {
+		dbg("(other sites) - %d live (%d total), %"PRIu32" B, peak %"PRIu32" B",
+			malloc_untracked.count, malloc_untracked.total, malloc_untracked.bytes, malloc_untracked.peak);
+	}
+#endif
+}
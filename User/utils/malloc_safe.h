@@ -3,15 +3,68 @@
 
 /**
  * Malloc that prints error and restarts the system on failure.
+ *
+ * With MALLOC_TRACK, live allocations are recorded by call site
+ * (file & line of the malloc_s / calloc_s). Blocks allocated this way
+ * must be released with free_s(). Print the table with malloc_track_dump().
  */
 
 #include <common.h>
 #include <stm32f1xx_hal.h>
 
+/** Record allocations by call site (adds MALLOC_TRACK_HEADER bytes to each block) */
+#ifndef MALLOC_TRACK
+#define MALLOC_TRACK 0
+#endif
+
+/** Max number of tracked call sites */
+#ifndef MALLOC_TRACK_SITES
+#define MALLOC_TRACK_SITES 8
+#endif
+
+/** Per-block overhead with tracking on (keeps the 8-byte alignment) */
+#define MALLOC_TRACK_HEADER 8
+
+/** Allocations from one call site */
+typedef struct {
+	const char *file;
+	uint32_t line;
+	uint16_t count; ///< live blocks
+	uint16_t total; ///< blocks allocated since boot
+	uint32_t bytes; ///< live bytes (as requested)
+	uint32_t peak;  ///< max live bytes
+} malloc_site_t;
+
+/** Heap statistics */
+typedef struct {
+	uint32_t arena;       ///< bytes obtained from _sbrk
+	uint32_t used;        ///< bytes in allocated chunks
+	uint32_t free;        ///< bytes in free chunks
+	uint32_t free_chunks; ///< number of free chunks
+	uint32_t top_free;    ///< free space at the top of the heap (releasable)
+	uint32_t brk;         ///< current _sbrk break
+	uint32_t sp;          ///< current stack pointer
+} malloc_stats_t;
+
 void *malloc_safe_do(size_t size, const char* file, uint32_t line);
 void *calloc_safe_do(size_t nmemb, size_t size, const char* file, uint32_t line);
+void free_safe_do(void *ptr);
 
 #define malloc_s(size)        malloc_safe_do(size,        __FILE__, __LINE__)
 #define calloc_s(nmemb, size) calloc_safe_do(nmemb, size, __FILE__, __LINE__)
+#define free_s(ptr)           free_safe_do(ptr)
+
+/** Get heap statistics */
+void malloc_get_stats(malloc_stats_t *stats);
+
+/**
+ * @brief Get a call site record (only with MALLOC_TRACK).
+ * @param n : site index
+ * @return the record, NULL if n is out of range
+ */
+const malloc_site_t *malloc_track_site(size_t n);
+
+/** Print heap statistics and the call site table to the debug output */
+void malloc_track_dump(void);
 
 #endif //MPORK_MALLOC_SAFE_H
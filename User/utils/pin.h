@@ -0,0 +1,60 @@
+#ifndef MPORK_PIN_H
+#define MPORK_PIN_H
+
+/**
+ * Compile-time GPIO pins.
+ *
+ * A pin is defined as "port letter, pin number":
+ *
+ *   #define LED1 C, 13
+ *
+ *   pin_set(LED1);
+ *   if (pin_read(BTN1)) ...
+ *
+ * Everything resolves to a constant address, so each access is a single
+ * store or load: set / clear / write go through BSRR / BRR (atomic),
+ * read and toggle use the Cortex-M3 bit-band alias of IDR / ODR.
+ *
+ * The port clock and pin mode still have to be set up (e.g. by MX_GPIO_Init).
+ */
+
+#include <common.h>
+
+/** Bit-band alias of a bit in the peripheral region */
+#define PIN_BITBAND(addr, bit) \
+	(*(volatile uint32_t *) (PERIPH_BB_BASE + (((uint32_t) (addr)) - PERIPH_BASE) * 32 + (bit) * 4))
+
+// Pin definitions are expanded through a second macro, so "LED1" splits into port and number
+#define PIN_PORT_(port, n)        (GPIO##port)
+#define PIN_MASK_(port, n)        ((uint16_t) (1U << (n)))
+#define PIN_SET_(port, n)         (GPIO##port->BSRR = (1UL << (n)))
+#define PIN_CLEAR_(port, n)       (GPIO##port->BRR = (1UL << (n)))
+#define PIN_WRITE_(port, n, v)    (GPIO##port->BSRR = (1UL << (n)) << ((v) ? 0 : 16))
+#define PIN_IDR_BIT_(port, n)     PIN_BITBAND(GPIO##port##_BASE + 0x08, n)
+#define PIN_ODR_BIT_(port, n)     PIN_BITBAND(GPIO##port##_BASE + 0x0C, n)
+
+/** Get the port (GPIO_TypeDef *), for HAL calls */
+#define pin_port(p)       PIN_PORT_(p)
+
+/** Get the pin mask (GPIO_PIN_x), for HAL calls */
+#define pin_mask(p)       PIN_MASK_(p)
+
+/** Set the output high */
+#define pin_set(p)        PIN_SET_(p)
+
+/** Set the output low */
+#define pin_clear(p)      PIN_CLEAR_(p)
+
+/** Set the output to a value */
+#define pin_write(p, v)   PIN_WRITE_(p, v)
+
+/** Read the input level (0 or 1) */
+#define pin_read(p)       ((bool) PIN_IDR_BIT_(p))
+
+/** Read back the output latch (0 or 1) */
+#define pin_read_out(p)   ((bool) PIN_ODR_BIT_(p))
+
+/** Toggle the output. Other pins of the port are not affected, even by a concurrent BSRR write. */
+#define pin_toggle(p)     (PIN_ODR_BIT_(p) ^= 1)
+
+#endif //MPORK_PIN_H
@@ -0,0 +1,205 @@
+#include <common.h>
+#include "pwm.h"
+#include "timhw.h"
+#include "clock.h"
+
+struct pwm {
+	TIM_HandleTypeDef htim;
+	uint32_t freq;  ///< requested frequency
+	uint8_t dma;    ///< DMA1 channel of the update request
+	bool seq_loop;  ///< running sequence is circular
+};
+
+static struct pwm pwms[PWM_MAX];
+static size_t pwm_count = 0;
+
+static void pwm_retime(uint32_t hclk);
+
+
+/** Get the preload (duty) register of a channel */
+static inline volatile uint32_t *pwm_ccr(pwm_t *pwm, uint8_t channel)
+{
+	return &pwm->htim.Instance->CCR1 + (channel - 1);
+}
+
+
+/** Find the prescaler for a frequency at a fixed resolution */
+static bool pwm_prescaler(TIM_TypeDef *tim, uint32_t freq, uint32_t resolution, uint32_t *psc)
+{
+	if (freq == 0) return false;
+
+	uint32_t div = tim_input_clock(tim) / resolution / freq;
+	if (div < 1 || div > 65536) return false;
+
+	*psc = div - 1;
+	return true;
+}
+
+
+/** Set up a timer for PWM */
+pwm_t *pwm_init(const pwm_init_t *init)
+{
+	if (pwm_count >= PWM_MAX) return NULL;
+	if (!tim_clock_enable(init->tim)) return NULL;
+
+	uint32_t psc, arr;
+	if (init->resolution == 0) {
+		uint16_t psc16, arr16;
+		if (!tim_rate_config(init->tim, init->freq, &psc16, &arr16)) return NULL;
+		psc = psc16;
+		arr = arr16;
+	} else {
+		if (init->resolution < 2) return NULL;
+		if (!pwm_prescaler(init->tim, init->freq, init->resolution, &psc)) return NULL;
+		arr = init->resolution - 1u;
+	}
+
+	if (pwm_count == 0) {
+		clock_add_listener(pwm_retime);
+	}
+
+	struct pwm *pwm = &pwms[pwm_count];
+	pwm->freq = init->freq;
+	pwm->dma = tim_up_dma(init->tim);
+	pwm->seq_loop = false;
+
+	TIM_HandleTypeDef *htim = &pwm->htim;
+	htim->Instance = init->tim;
+	htim->State = HAL_TIM_STATE_RESET;
+	htim->Lock = HAL_UNLOCKED;
+	htim->Init.Prescaler = psc;
+	htim->Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim->Init.Period = arr;
+	htim->Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim->Init.RepetitionCounter = 0;
+
+	if (HAL_TIM_PWM_Init(htim) != HAL_OK) return NULL;
+
+	htim->Instance->CR1 |= TIM_CR1_ARPE;
+	__HAL_TIM_ENABLE(htim);
+
+	pwm_count++;
+	return pwm;
+}
+
+
+/** Enable a channel output */
+bool pwm_channel_enable(pwm_t *pwm, uint8_t channel, bool invert)
+{
+	if (channel < 1 || channel > 4) return false;
+
+	TIM_OC_InitTypeDef oc;
+	oc.OCMode = TIM_OCMODE_PWM1;
+	oc.Pulse = 0;
+	oc.OCPolarity = invert ? TIM_OCPOLARITY_LOW : TIM_OCPOLARITY_HIGH;
+	oc.OCNPolarity = TIM_OCNPOLARITY_HIGH;
+	oc.OCFastMode = TIM_OCFAST_DISABLE;
+	oc.OCIdleState = TIM_OCIDLESTATE_RESET;
+	oc.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+
+	// sets the preload enable too
+	uint32_t hal_ch = (channel - 1u) * 4; // TIM_CHANNEL_x
+	if (HAL_TIM_PWM_ConfigChannel(&pwm->htim, &oc, hal_ch) != HAL_OK) return false;
+
+	tim_pin_init(pwm->htim.Instance, channel, GPIO_MODE_AF_PP, GPIO_NOPULL);
+
+	return HAL_TIM_PWM_Start(&pwm->htim, hal_ch) == HAL_OK;
+}
+
+
+/** Set a channel's duty */
+bool pwm_set(pwm_t *pwm, uint8_t channel, uint16_t duty)
+{
+	if (channel < 1 || channel > 4) return false;
+
+	*pwm_ccr(pwm, channel) = duty;
+	return true;
+}
+
+
+/** Get the resolution */
+uint16_t pwm_resolution(pwm_t *pwm)
+{
+	return (uint16_t) (pwm->htim.Instance->ARR + 1);
+}
+
+
+/** Get the actual PWM frequency */
+uint32_t pwm_get_freq(pwm_t *pwm)
+{
+	TIM_TypeDef *tim = pwm->htim.Instance;
+	return tim_input_clock(tim) / (tim->PSC + 1) / (tim->ARR + 1);
+}
+
+
+/** Change the frequency, keeping the resolution */
+bool pwm_set_freq(pwm_t *pwm, uint32_t freq)
+{
+	uint32_t psc;
+	if (!pwm_prescaler(pwm->htim.Instance, freq, pwm->htim.Instance->ARR + 1, &psc)) return false;
+
+	pwm->freq = freq;
+	pwm->htim.Instance->PSC = psc; // applied at the next update
+	return true;
+}
+
+
+/** Feed a channel with a duty sequence */
+bool pwm_sequence(pwm_t *pwm, uint8_t channel, const uint16_t *duty, size_t len, bool loop)
+{
+	if (channel < 1 || channel > 4) return false;
+	if (pwm->dma == 0 || len == 0 || len > 0xFFFF) return false;
+
+	pwm_sequence_stop(pwm);
+
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	// the update request writes the preload register, which is applied at the following update
+	DMA_Channel_TypeDef *ch = dma1_channel(pwm->dma);
+	ch->CPAR = (uint32_t) pwm_ccr(pwm, channel);
+	ch->CMAR = (uint32_t) duty;
+	ch->CNDTR = len;
+	DMA1->IFCR = dma1_flag(pwm->dma, DMA_IFCR_CGIF1);
+
+	// memory to peripheral, 16-bit, no interrupts
+	uint32_t ccr = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_PL_0;
+	if (loop) ccr |= DMA_CCR_CIRC;
+	ch->CCR = ccr | DMA_CCR_EN;
+
+	pwm->seq_loop = loop;
+	pwm->htim.Instance->DIER |= TIM_DIER_UDE;
+
+	return true;
+}
+
+
+/** Stop a running sequence */
+void pwm_sequence_stop(pwm_t *pwm)
+{
+	if (pwm->dma == 0) return;
+
+	pwm->htim.Instance->DIER &= ~TIM_DIER_UDE;
+	dma1_channel(pwm->dma)->CCR = 0;
+	pwm->seq_loop = false;
+}
+
+
+/** Check if a sequence is running */
+bool pwm_sequence_busy(pwm_t *pwm)
+{
+	if (!(pwm->htim.Instance->DIER & TIM_DIER_UDE)) return false;
+
+	return pwm->seq_loop || dma1_channel(pwm->dma)->CNDTR != 0;
+}
+
+
+/** Keep the frequencies after a clock change */
+static void pwm_retime(uint32_t hclk)
+{
+	UNUSED(hclk);
+
+	for (size_t i = 0; i < pwm_count; i++) {
+		// if the clock is now too slow, the old prescaler stays
+		pwm_set_freq(&pwms[i], pwms[i].freq);
+	}
+}
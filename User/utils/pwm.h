@@ -0,0 +1,87 @@
+#ifndef MPORK_PWM_H
+#define MPORK_PWM_H
+
+/**
+ * Hardware PWM on timer channels.
+ *
+ * All channels of a timer share the frequency and resolution. Duty
+ * registers are preloaded, so a new duty takes effect at the start of
+ * the next period - no glitches or runt pulses.
+ *
+ * A duty sequence (fade, waveform) is fed to one channel by DMA on the
+ * timer update event, one value per PWM period, without interrupts.
+ *
+ * The resolution is kept across clock profile changes and the prescaler
+ * is retimed to keep the frequency, so duty values stay valid.
+ *
+ * Pins are the default channel pins (see timhw.h). The timer update
+ * DMA channel is used while a sequence runs.
+ */
+
+#include <common.h>
+
+/** Max number of PWM timers */
+#define PWM_MAX 3
+
+typedef struct {
+	TIM_TypeDef *tim;    ///< timer
+	uint32_t freq;       ///< PWM frequency (Hz)
+	uint16_t resolution; ///< steps per period (duty 0 - resolution), 0 = the most the clock allows
+} pwm_init_t;
+
+typedef struct pwm pwm_t;
+
+/**
+ * @brief Set up a timer for PWM. Channels are enabled separately.
+ * @return the PWM timer, NULL on failure (e.g. frequency x resolution above the timer clock)
+ */
+pwm_t *pwm_init(const pwm_init_t *init);
+
+/**
+ * @brief Enable a channel output, with duty 0.
+ * @param channel : 1-4
+ * @param invert  : active low output
+ * @return success
+ */
+bool pwm_channel_enable(pwm_t *pwm, uint8_t channel, bool invert);
+
+/**
+ * @brief Set a channel's duty, applied at the next period.
+ * @param channel : 1-4
+ * @param duty    : 0 - resolution
+ * @return false if the channel is out of range
+ */
+bool pwm_set(pwm_t *pwm, uint8_t channel, uint16_t duty);
+
+/** Get the resolution (duty for 100 %) */
+uint16_t pwm_resolution(pwm_t *pwm);
+
+/** Get the actual PWM frequency (Hz) */
+uint32_t pwm_get_freq(pwm_t *pwm);
+
+/**
+ * @brief Change the frequency, keeping the resolution and duties.
+ * @return false if the timer clock is too low for it
+ */
+bool pwm_set_freq(pwm_t *pwm, uint32_t freq);
+
+/**
+ * @brief Feed a channel with a duty sequence, one value per period.
+ *
+ * Only one sequence per timer can run; a running one is stopped.
+ * A one-shot sequence leaves the last duty in place.
+ *
+ * @param duty : duty values, read by DMA - must stay valid while running
+ * @param len  : number of values (max 65535)
+ * @param loop : repeat until stopped
+ * @return success
+ */
+bool pwm_sequence(pwm_t *pwm, uint8_t channel, const uint16_t *duty, size_t len, bool loop);
+
+/** Stop a running sequence, the current duty stays */
+void pwm_sequence_stop(pwm_t *pwm);
+
+/** Check if a sequence is running */
+bool pwm_sequence_busy(pwm_t *pwm);
+
+#endif //MPORK_PWM_H
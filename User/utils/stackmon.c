@@ -0,0 +1,129 @@
+#include <common.h>
+#include <unistd.h>
+#include "stackmon.h"
+#include "timebase.h"
+#include "debug.h"
+#include "fault.h"
+
+/** Linker symbols */
+extern uint32_t _estack;
+extern uint32_t _sstack;
+extern uint32_t _heap_limit;
+
+/** Deepest SP seen by stack_isr_sample() */
+static uint32_t isr_min_sp = 0xFFFFFFFF;
+
+/** Warning already printed */
+static bool warned = false;
+
+/** Set by the tick, the check itself runs in stackmon_poll() */
+static volatile bool check_due = false;
+
+static void stackmon_task(void *unused);
+
+
+/** Start the periodic stack check */
+void stackmon_init(void)
+{
+	add_periodic_task(stackmon_task, NULL, STACK_CHECK_INTERVAL, false);
+}
+
+
+/** Find the lowest overwritten word (the high-water mark) */
+static uint32_t *stack_hwm(void)
+{
+	// the heap may have used painted memory, start above its break
+	uint32_t *p = (uint32_t *) (((uint32_t) sbrk(0) + 3) & ~3UL);
+	uint32_t *sp = (uint32_t *) __get_MSP();
+
+	while (p < sp && *p == STACK_PAINT) p++;
+
+	return p;
+}
+
+
+/** Get the peak stack usage */
+size_t stack_used(void)
+{
+	return (size_t) ((uint32_t) &_estack - (uint32_t) stack_hwm());
+}
+
+
+/** Get the size of the stack reservation */
+size_t stack_reserved(void)
+{
+	return (size_t) ((uint32_t) &_estack - (uint32_t) &_sstack);
+}
+
+
+/** Get the free space below the high-water mark */
+size_t stack_free(void)
+{
+	return (size_t) ((uint32_t) stack_hwm() - (uint32_t) sbrk(0));
+}
+
+
+/** Record the stack depth in an ISR */
+RAMFUNC void stack_isr_sample(void)
+{
+	uint32_t sp = __get_MSP();
+	if (sp < isr_min_sp) isr_min_sp = sp;
+}
+
+
+/** Check the guard gap below the stack */
+RAMFUNC void stack_guard_check(void)
+{
+	// the top word is hit first, but a big frame can skip over it
+	for (const uint32_t *p = &_heap_limit; p < &_sstack; p++) {
+		if (*p != STACK_PAINT) {
+			fault_panic("Stack overflow into the heap guard");
+		}
+	}
+}
+
+
+/** Get the peak stack usage seen by stack_isr_sample() */
+size_t stack_isr_peak(void)
+{
+	if (isr_min_sp == 0xFFFFFFFF) return 0;
+	return (size_t) ((uint32_t) &_estack - isr_min_sp);
+}
+
+
+/** Print stack usage */
+void stack_report(void)
+{
+	size_t used = stack_used();
+	size_t reserved = stack_reserved();
+
+	info("Stack: %d of %d B used (%d%%), peak at SysTick entry %d B, %d B free above heap",
+		 (int) used, (int) reserved, (int) (used * 100 / reserved),
+		 (int) stack_isr_peak(), (int) stack_free());
+}
+
+
+/** Periodic tick - only flags the check, the scan is too long for SysTick */
+static void stackmon_task(void *unused)
+{
+	UNUSED(unused);
+	check_due = true;
+}
+
+
+/** Check the usage when due, from the main loop */
+void stackmon_poll(void)
+{
+	if (!check_due) return;
+	check_due = false;
+
+	if (warned) return;
+
+	size_t used = stack_used();
+	size_t reserved = stack_reserved();
+
+	if (used * 100 > reserved * STACK_WARN_PERCENT) {
+		warned = true;
+		warn("Stack usage high: %d of %d B", (int) used, (int) reserved);
+	}
+}
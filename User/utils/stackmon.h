@@ -0,0 +1,74 @@
+#ifndef MPORK_STACKMON_H
+#define MPORK_STACKMON_H
+
+/**
+ * Stack usage monitoring.
+ *
+ * Reset_Handler paints the free RAM between the heap and the stack with
+ * STACK_PAINT. The high-water mark is found by scanning up from the heap
+ * break for the first overwritten word.
+ *
+ * All interrupts run on the main stack, so the figures include ISR usage.
+ *
+ * Below the stack reservation (_Min_Stack_Size) is a guard gap
+ * (_Stack_Guard_Size) the heap can't grow into. It stays painted
+ * unless the stack overflows; stack_guard_check() turns that into
+ * a fault_panic() before the heap is corrupted.
+ */
+
+#include <common.h>
+
+/** Paint pattern, keep in sync with StackPaint in the startup file */
+#define STACK_PAINT 0xDEADBEEF
+
+/** Interval of the periodic check (ms) */
+#define STACK_CHECK_INTERVAL 100
+
+/** Warn when this much of the reserved stack (_Min_Stack_Size) is used */
+#define STACK_WARN_PERCENT 80
+
+/**
+ * @brief Start the periodic stack check.
+ *
+ * Warns when usage crosses STACK_WARN_PERCENT of the reservation.
+ * The tick only flags the check, stackmon_poll() does it.
+ *
+ * Requires timebase.
+ */
+void stackmon_init(void);
+
+/** Run the stack check when due. Call from the main loop. */
+void stackmon_poll(void);
+
+/** Get the peak stack usage in bytes */
+size_t stack_used(void);
+
+/** Get the size of the stack reservation (_Min_Stack_Size) */
+size_t stack_reserved(void);
+
+/** Get the number of painted bytes left between the heap and the deepest stack point */
+size_t stack_free(void);
+
+/**
+ * @brief Record the stack depth in an ISR. Called from the SysTick handler.
+ *
+ * Gives the deepest SP seen on entry to that handler (i.e. what the
+ * interrupted code was using), see stack_isr_peak(). Other interrupts
+ * are not sampled.
+ */
+void stack_isr_sample(void);
+
+/**
+ * @brief Check that the guard gap below the stack is intact. Called from SysTick.
+ *
+ * Panics (report, crash dump, reset) if the stack has reached into the guard.
+ */
+void stack_guard_check(void);
+
+/** Get the peak stack usage seen by stack_isr_sample() (on SysTick entry only) */
+size_t stack_isr_peak(void);
+
+/** Print stack usage to the debug output */
+void stack_report(void);
+
+#endif //MPORK_STACKMON_H
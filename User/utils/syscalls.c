@@ -1,13 +1,18 @@
 #include <errno.h>
 #include <stdio.h>
-#include <usart.h>
 #include <sys/stat.h>
+#include "debug.h"
 
-register char *stack_ptr asm("sp");
-
+/**
+ * @brief Grow the heap. Used by malloc().
+ *
+ * The heap is bounded by _heap_limit from the linker script, which leaves
+ * the stack reservation and a guard gap above it (see stackmon.h).
+ */
 caddr_t _sbrk(int incr)
 {
 	extern char end __asm("end");
+	extern char _heap_limit;
 	static char *heap_end;
 	char *prev_heap_end;
 
@@ -15,9 +20,7 @@ caddr_t _sbrk(int incr)
 		heap_end = &end;
 
 	prev_heap_end = heap_end;
-	if (heap_end + incr > stack_ptr) {
-//		write(1, "Heap and stack collision\n", 25);
-//		abort();
+	if (incr > &_heap_limit - heap_end || incr < &end - heap_end) {
 		errno = ENOMEM;
 		return (caddr_t) -1;
 	}
@@ -41,7 +44,7 @@ int _write(int fd, const char *buf, int len)
 	switch (fd) {
 		case 1: // stdout
 		case 2: // stderr
-			HAL_UART_Transmit(&huart1, (uint8_t*)buf, len, 10);
+			dbg_sink_write(buf, (size_t) len);
 			return len;
 
 		default:
@@ -0,0 +1,123 @@
+#include <common.h>
+#include <string.h>
+#include <usart.h>
+#include "telemetry.h"
+#include "timebase.h"
+#include "cobs.h"
+#include "crc.h"
+
+// channel, seq, time
+#define TELEM_HEADER_LEN 4
+#define TELEM_CRC_LEN 2
+#define TELEM_FRAME_MAX (TELEM_HEADER_LEN + TELEM_MAX_PAYLOAD + TELEM_CRC_LEN)
+
+// UART timeout for one frame (ms)
+#define TELEM_TX_TIMEOUT 20
+
+/** Frame sequence number, lets the host detect lost frames */
+static uint8_t telem_seq = 0;
+
+/** Wrap debug output in text frames */
+static bool telem_frame_text = false;
+
+
+/** Send a frame with raw payload */
+bool telem_send(telem_channel_t ch, const void *payload, size_t len)
+{
+	if (len > TELEM_MAX_PAYLOAD) return false;
+
+	uint8_t frame[TELEM_FRAME_MAX];
+	uint8_t encoded[COBS_MAX_ENCODED(TELEM_FRAME_MAX) + 1];
+
+	uint16_t time = (uint16_t) ms_now();
+
+	frame[0] = (uint8_t) ch;
+	frame[1] = telem_seq++;
+	frame[2] = (uint8_t) time;
+	frame[3] = (uint8_t) (time >> 8);
+	memcpy(&frame[TELEM_HEADER_LEN], payload, len);
+
+	size_t n = TELEM_HEADER_LEN + len;
+	uint16_t crc = crc16_ccitt(CRC16_INIT, frame, n);
+	frame[n++] = (uint8_t) crc;
+	frame[n++] = (uint8_t) (crc >> 8);
+
+	size_t enc_len = cobs_encode(frame, n, encoded);
+	encoded[enc_len++] = 0x00; // delimiter
+
+	return HAL_UART_Transmit(&huart1, encoded, (uint16_t) enc_len, TELEM_TX_TIMEOUT) == HAL_OK;
+}
+
+
+/** Send a counter value */
+bool telem_counter(uint8_t id, uint32_t value)
+{
+	uint8_t buf[5] = {
+		id,
+		(uint8_t) value,
+		(uint8_t) (value >> 8),
+		(uint8_t) (value >> 16),
+		(uint8_t) (value >> 24),
+	};
+
+	return telem_send(TELEM_CH_COUNTER, buf, sizeof(buf));
+}
+
+
+/** Send a set of sensor samples */
+bool telem_samples(uint8_t sensor, const int16_t *values, size_t count)
+{
+	if (count > TELEM_MAX_SAMPLES) return false;
+
+	uint8_t buf[1 + TELEM_MAX_SAMPLES * 2];
+	buf[0] = sensor;
+
+	for (size_t i = 0; i < count; i++) {
+		buf[1 + i * 2] = (uint8_t) values[i];
+		buf[2 + i * 2] = (uint8_t) ((uint16_t) values[i] >> 8);
+	}
+
+	return telem_send(TELEM_CH_SAMPLE, buf, 1 + count * 2);
+}
+
+
+/** Send an event */
+bool telem_event(uint16_t code, uint32_t arg)
+{
+	uint8_t buf[6] = {
+		(uint8_t) code,
+		(uint8_t) (code >> 8),
+		(uint8_t) arg,
+		(uint8_t) (arg >> 8),
+		(uint8_t) (arg >> 16),
+		(uint8_t) (arg >> 24),
+	};
+
+	return telem_send(TELEM_CH_EVENT, buf, sizeof(buf));
+}
+
+
+/** Send text on the text channel */
+void telem_text(const char *text, size_t len)
+{
+	while (len > 0) {
+		size_t chunk = (len > TELEM_MAX_PAYLOAD) ? TELEM_MAX_PAYLOAD : len;
+		telem_send(TELEM_CH_TEXT, text, chunk);
+		text += chunk;
+		len -= chunk;
+	}
+}
+
+
+/** Enable or disable framing of the debug log */
+void telem_set_text_framing(bool enable)
+{
+	telem_frame_text = enable;
+}
+
+
+/** Check if debug output is being framed */
+bool telem_text_framing(void)
+{
+	return telem_frame_text;
+}
@@ -0,0 +1,80 @@
+#ifndef MPORK_TELEMETRY_H
+#define MPORK_TELEMETRY_H
+
+/**
+ * Binary telemetry over USART1.
+ *
+ * Each record is sent as one frame:
+ *
+ *   COBS( channel:u8 | seq:u8 | time_ms:u16 | payload... | crc16:u16 ) 0x00
+ *
+ * - Multi-byte fields are little endian.
+ * - time_ms are the low 16 bits of ms_now().
+ * - crc16 is CRC-16/CCITT-FALSE over the fields before it.
+ *
+ * Payload by channel:
+ *
+ *   TELEM_CH_TEXT     text bytes (debug log, when text framing is enabled)
+ *   TELEM_CH_COUNTER  id:u8 | value:u32
+ *   TELEM_CH_SAMPLE   sensor:u8 | values:i16[]
+ *   TELEM_CH_EVENT    code:u16 | arg:u32
+ *
+ * Use tools/telemetry.py to decode the stream on the host.
+ */
+
+#include <common.h>
+
+/** Frame channel IDs */
+typedef enum {
+	TELEM_CH_TEXT = 0,
+	TELEM_CH_COUNTER = 1,
+	TELEM_CH_SAMPLE = 2,
+	TELEM_CH_EVENT = 3,
+} telem_channel_t;
+
+/** Max payload length of a frame */
+#define TELEM_MAX_PAYLOAD 64
+
+/** Max number of values in one sample record */
+#define TELEM_MAX_SAMPLES ((TELEM_MAX_PAYLOAD - 1) / 2)
+
+/**
+ * @brief Send a frame with raw payload.
+ * @param ch      : channel
+ * @param payload : payload data
+ * @param len     : payload length, max TELEM_MAX_PAYLOAD
+ * @return success
+ */
+bool telem_send(telem_channel_t ch, const void *payload, size_t len);
+
+/** Send a counter value */
+bool telem_counter(uint8_t id, uint32_t value);
+
+/** Send a set of sensor samples (max TELEM_MAX_SAMPLES) */
+bool telem_samples(uint8_t sensor, const int16_t *values, size_t count);
+
+/** Send an event */
+bool telem_event(uint16_t code, uint32_t arg);
+
+/**
+ * @brief Send text on the text channel (split into frames as needed)
+ * @param text : characters to send
+ * @param len  : length
+ */
+void telem_text(const char *text, size_t len);
+
+/**
+ * @brief Enable or disable framing of the debug log.
+ *
+ * When enabled, all debug output (dbg(), printf()...) is wrapped in TELEM_CH_TEXT
+ * frames, so text and binary records can share the UART. Has no effect if the
+ * debug output goes to the ITM.
+ *
+ * @param enable : framing enabled
+ */
+void telem_set_text_framing(bool enable);
+
+/** Check if debug output is being framed */
+bool telem_text_framing(void);
+
+#endif //MPORK_TELEMETRY_H
@@ -2,7 +2,16 @@
 
 #include "debug.h"
 #include "timebase.h"
-#include "malloc_safe.h"
+#include "arena.h"
+#include "cycles.h"
+
+#if DEBUG_USE_ITM
+#include "itm.h"
+// Report task switches on the ITM task channel (PID_NONE = back in the tick handler)
+#define trace_task(pid) itm_event(ITM_CH_TASK, (pid))
+#else
+#define trace_task(pid)
+#endif
 
 // Time base
 static volatile ms_time_t SystemTime_ms = 0;
@@ -40,6 +49,11 @@ typedef struct {
 } future_task_t;
 
 
+// PID = gen << 8 | (index + 1)
+#define PID_INDEX_BITS 8
+#define PID_INDEX_MASK ((1 << PID_INDEX_BITS) - 1)
+
+
 static size_t periodic_slot_count = 0;
 static size_t future_slot_count = 0;
 
@@ -50,28 +64,109 @@ static future_task_t *future_tasks;
 /** Init timebase */
 void timebase_init(size_t periodic, size_t future)
 {
+	// the slot index must fit in a PID
+	if (periodic > PID_INDEX_MASK) periodic = PID_INDEX_MASK;
+	if (future > PID_INDEX_MASK) future = PID_INDEX_MASK;
+
 	periodic_slot_count = periodic;
 	future_slot_count = future;
 
-	periodic_tasks = calloc_s(periodic, sizeof(periodic_task_t));
-	future_tasks = calloc_s(future, sizeof(future_task_t));
+	periodic_tasks = arena_calloc_s(periodic, sizeof(periodic_task_t));
+	future_tasks = arena_calloc_s(future, sizeof(future_task_t));
+
+	delay_calibrate();
 }
 
 
-static task_pid_t next_task_pid = 1; // 0 (PID_NONE) is reserved
+task_table_t timebase_alloc_tables(size_t periodic, size_t future)
+{
+	if (periodic > PID_INDEX_MASK) periodic = PID_INDEX_MASK;
+	if (future > PID_INDEX_MASK) future = PID_INDEX_MASK;
+
+	// at least one entry each, so NULL always means out of memory
+	task_table_t table = {
+		.periodic = calloc(periodic ? periodic : 1, sizeof(periodic_task_t)),
+		.periodic_count = periodic,
+		.future = calloc(future ? future : 1, sizeof(future_task_t)),
+		.future_count = future,
+		.now = SystemTime_ms,
+	};
+
+	if (table.periodic == NULL || table.future == NULL) {
+		timebase_free_tables(table);
+		table.periodic = NULL;
+		table.future = NULL;
+		table.periodic_count = 0;
+		table.future_count = 0;
+	}
 
+	return table;
+}
 
-/** Get a valid free PID for a new task. */
-static task_pid_t make_pid(void)
+
+void timebase_free_tables(task_table_t table)
 {
-	task_pid_t pid = next_task_pid++;
+	free(table.periodic);
+	free(table.future);
+}
+
+
+task_table_t timebase_swap_tables(task_table_t table)
+{
+	task_table_t old = {
+		.periodic = periodic_tasks,
+		.periodic_count = periodic_slot_count,
+		.future = future_tasks,
+		.future_count = future_slot_count,
+		.now = SystemTime_ms,
+	};
+
+	periodic_tasks = table.periodic;
+	periodic_slot_count = table.periodic_count;
+	future_tasks = table.future;
+	future_slot_count = table.future_count;
+	SystemTime_ms = table.now;
+
+	return old;
+}
+
+
+/** Generation for the next PID */
+static uint32_t next_task_gen = 0;
+
+/** Make a PID for a task in a slot. Never PID_NONE. */
+static task_pid_t make_pid(size_t index)
+{
+	return (next_task_gen++ << PID_INDEX_BITS) | (task_pid_t) (index + 1);
+}
+
+
+/** Get the slot index encoded in a PID (may be out of range) */
+static inline size_t pid_index(task_pid_t pid)
+{
+	return (size_t) (pid & PID_INDEX_MASK) - 1;
+}
+
+
+/** Find a periodic task by PID, NULL if not found or stale */
+static periodic_task_t *find_periodic_task(task_pid_t pid)
+{
+	size_t i = pid_index(pid);
+	if (pid == PID_NONE || i >= periodic_slot_count) return NULL;
+
+	periodic_task_t *task = &periodic_tasks[i];
+	return (task->pid == pid) ? task : NULL;
+}
 
-	// make sure no task is given PID 0
-	if (next_task_pid == PID_NONE) {
-		next_task_pid++;
-	}
 
-	return pid;
+/** Find a future task by PID, NULL if not found or stale */
+static future_task_t *find_future_task(task_pid_t pid)
+{
+	size_t i = pid_index(pid);
+	if (pid == PID_NONE || i >= future_slot_count) return NULL;
+
+	future_task_t *task = &future_tasks[i];
+	return (task->pid == pid) ? task : NULL;
 }
 
 
@@ -85,7 +180,7 @@ static periodic_task_t* claim_periodic_task_slot(ms_time_t interval, bool enqueu
 		task->countup = 0;
 		task->interval_ms = interval - 1;
 		task->enqueue = enqueue;
-		task->pid = make_pid();
+		task->pid = make_pid(i);
 		task->enabled = true;
 		return task;
 	}
@@ -105,7 +200,7 @@ static future_task_t* claim_future_task_slot(ms_time_t delay, bool enqueue)
 
 		task->countdown_ms = delay;
 		task->enqueue = enqueue;
-		task->pid = make_pid();
+		task->pid = make_pid(i);
 		return task;
 	}
 
@@ -145,85 +240,67 @@ task_pid_t schedule_task(void (*callback)(void*), void *arg, ms_time_t delay, bo
 /** Enable or disable a periodic task. */
 bool enable_periodic_task(task_pid_t pid, bool enable)
 {
-	if (pid == PID_NONE) return false;
-
-	for (size_t i = 0; i < periodic_slot_count; i++) {
-		periodic_task_t *task = &periodic_tasks[i];
-		if (task->pid != pid) continue;
+	periodic_task_t *task = find_periodic_task(pid);
+	if (task == NULL) return false;
 
-		task->enabled = (enable == ENABLE);
-		return true;
-	}
-
-	return false;
+	task->enabled = (enable == ENABLE);
+	return true;
 }
 
 
 /** Check if a periodic task is enabled */
 bool is_periodic_task_enabled(task_pid_t pid)
 {
-	if (pid == PID_NONE) return false;
+	periodic_task_t *task = find_periodic_task(pid);
+	if (task == NULL) return false;
 
-	for (size_t i = 0; i < periodic_slot_count; i++) {
-		periodic_task_t *task = &periodic_tasks[i];
-		if (task->pid != pid) continue;
-
-		return task->enabled;
-	}
-
-	return false;
+	return task->enabled;
 }
 
 bool reset_periodic_task(task_pid_t pid)
 {
-	if (pid == PID_NONE) return false;
-
-	for (size_t i = 0; i < periodic_slot_count; i++) {
-		periodic_task_t *task = &periodic_tasks[i];
-		if (task->pid != pid) continue;
+	periodic_task_t *task = find_periodic_task(pid);
+	if (task == NULL) return false;
 
-		task->countup = 0;
-		return true;
-	}
-
-	return false;
+	task->countup = 0;
+	return true;
 }
 
 
 bool set_periodic_task_interval(task_pid_t pid, ms_time_t interval)
 {
-	if (pid == PID_NONE) return false;
-
-	for (size_t i = 0; i < periodic_slot_count; i++) {
-		periodic_task_t *task = &periodic_tasks[i];
-		if (task->pid != pid) continue;
-		task->interval_ms = interval;
-		return true;
-	}
+	periodic_task_t *task = find_periodic_task(pid);
+	if (task == NULL) return false;
 
-	return false;
+	task->interval_ms = interval;
+	return true;
 }
 
 
 /** Remove a periodic task. */
 bool remove_periodic_task(task_pid_t pid)
 {
-	if (pid == PID_NONE) return false;
+	periodic_task_t *task = find_periodic_task(pid);
+	if (task == NULL) return false;
 
-	for (size_t i = 0; i < periodic_slot_count; i++) {
-		periodic_task_t *task = &periodic_tasks[i];
-		if (task->pid != pid) continue;
-
-		task->pid = PID_NONE; // mark unused
-		return true;
-	}
-
-	return false;
+	task->pid = PID_NONE; // mark unused
+	return true;
 }
 
 
 /** Abort a scheduled task. */
 bool abort_scheduled_task(task_pid_t pid)
+{
+	future_task_t *task = find_future_task(pid);
+	if (task == NULL) return false;
+
+	task->pid = PID_NONE; // mark unused
+	return true;
+}
+
+
+/** abort_scheduled_task() with a linear search for the PID */
+bool abort_scheduled_task_linear(task_pid_t pid)
 {
 	if (pid == PID_NONE) return false;
 
@@ -250,7 +327,9 @@ static void run_periodic_task(periodic_task_t *task)
 		//tq_post(task->callback, task->cb_arg);
 	} else {
 		// immediate task
+		trace_task(task->pid);
 		task->callback(task->cb_arg);
+		trace_task(PID_NONE);
 	}
 }
 
@@ -264,15 +343,15 @@ static void run_future_task(future_task_t *task)
 		//tq_post(task->callback, task->cb_arg);
 	} else {
 		// immediate task
+		trace_task(task->pid);
 		task->callback(task->cb_arg);
+		trace_task(PID_NONE);
 	}
 }
 
 
-/**
- * @brief Millisecond callback, should be run in the SysTick handler.
- */
-void timebase_ms_cb(void)
+/** Body of the ms tick, built into timebase_ms_cb() (RAM) and timebase_ms_cb_flash() */
+static inline __attribute__((always_inline)) void timebase_tick(void)
 {
 	// increment global time
 	SystemTime_ms++;
@@ -305,6 +384,74 @@ void timebase_ms_cb(void)
 }
 
 
+/**
+ * @brief Millisecond callback, should be run in the SysTick handler.
+ */
+RAMFUNC void timebase_ms_cb(void)
+{
+	timebase_tick();
+}
+
+
+/** The same tick running from flash, to measure the RAMFUNC gain */
+void __attribute__((noinline)) timebase_ms_cb_flash(void)
+{
+	timebase_tick();
+}
+
+
+
+bool delay_use_dwt = false;
+uint32_t delay_cycles_per_us = 72;
+uint32_t delay_loop_cycles_x16 = 3 << 4;
+
+/** Iterations of the fallback loop timed by delay_calibrate() */
+#define DELAY_CALIB_LOOPS 256
+
+
+/** Measure the fallback loop against SysTick (counts core cycles) */
+static uint32_t delay_measure_loop(void)
+{
+	uint32_t reload = SysTick->LOAD + 1;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t start = SysTick->VAL;
+	delay_loop(DELAY_CALIB_LOOPS);
+	uint32_t end = SysTick->VAL;
+
+	__set_PRIMASK(primask);
+
+	// SysTick counts down and wraps at 'reload'
+	uint32_t cycles = (start >= end) ? (start - end) : (start + reload - end);
+
+	return (cycles << 4) / DELAY_CALIB_LOOPS;
+}
+
+
+/** Update the delay calibration */
+void delay_calibrate(void)
+{
+	delay_cycles_per_us = (SystemCoreClock + 500000) / 1000000;
+
+	// The loop cost depends on flash wait states, measure it.
+	// SysTick must run on HCLK (see SystemClock_Config).
+	if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) && (SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk)) {
+		uint32_t best = UINT32_MAX;
+		for (int i = 0; i < 4; i++) {
+			uint32_t m = delay_measure_loop();
+			if (m < best) best = m;
+		}
+
+		if (best > 0) delay_loop_cycles_x16 = best;
+	}
+
+	// CYCCNT is optional on Cortex-M3 (present on all STM32F1)
+	delay_use_dwt = !(DWT->CTRL & DWT_CTRL_NOCYCCNT_Msk);
+	if (delay_use_dwt) cycles_init();
+}
+
 
 /** Seconds delay */
 void delay_s(uint32_t s)
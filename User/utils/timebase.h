@@ -16,7 +16,13 @@
 #include <common.h>
 
 
-/** Task PID. */
+/**
+ * Task PID.
+ *
+ * Encodes the slot index (low 8 bits, +1) and a generation (upper bits),
+ * so lookup is O(1) and the PID of a finished task is rejected even
+ * after its slot was reused.
+ */
 typedef uint32_t task_pid_t;
 
 /** Time value in ms */
@@ -35,12 +41,46 @@ typedef uint32_t ms_time_t;
         if (suc) break; \
     }
 
-/** Init timebase, allocate slots for tasks. */
+/** Init timebase, allocate slots for tasks (max 255 of each). */
 void timebase_init(size_t periodic_count, size_t future_count);
 
+/** Task tables and the time, see timebase_swap_tables() */
+typedef struct {
+	void *periodic;
+	size_t periodic_count;
+	void *future;
+	size_t future_count;
+	ms_time_t now;
+} task_table_t;
+
+/**
+ * @brief Allocate empty task tables on the heap (for benchmarks).
+ *
+ * The time starts at the current ms_now().
+ *
+ * @return the tables, both NULL if out of memory
+ */
+task_table_t timebase_alloc_tables(size_t periodic_count, size_t future_count);
+
+/** Free tables from timebase_alloc_tables() */
+void timebase_free_tables(task_table_t table);
+
+/**
+ * @brief Install other task tables and time (for benchmarks).
+ *
+ * Tasks in the old tables don't run, and ms ticks don't advance the old
+ * time until it's swapped back. Call with interrupts disabled.
+ *
+ * @return the previous tables
+ */
+task_table_t timebase_swap_tables(task_table_t table);
+
 /** Must be called every 1 ms */
 void timebase_ms_cb(void);
 
+/** timebase_ms_cb() built to run from flash, for benchmarks (has the same effect) */
+void timebase_ms_cb_flash(void);
+
 
 // --- Periodic -----------------------------------------------
 
@@ -89,6 +129,9 @@ task_pid_t schedule_task(void (*callback_arg)(void *), void *arg, ms_time_t dela
 /** Abort a scheduled task. */
 bool abort_scheduled_task(task_pid_t pid);
 
+/** abort_scheduled_task() with a linear search for the PID, as before PIDs held the slot index (for benchmarks) */
+bool abort_scheduled_task_linear(task_pid_t pid);
+
 
 // --- Waiting functions --------------------------------------
 
@@ -108,24 +151,62 @@ void delay_ms(ms_time_t ms);
 void delay_s(uint32_t s);
 
 
+/** Use the DWT cycle counter for delays (false = calibrated loop), set by delay_calibrate() */
+extern bool delay_use_dwt;
+
+/** Core cycles per microsecond, set by delay_calibrate() */
+extern uint32_t delay_cycles_per_us;
+
+/** Cycles per iteration of the fallback loop, x16 fixed point, set by delay_calibrate() */
+extern uint32_t delay_loop_cycles_x16;
+
+/**
+ * @brief Update the delay calibration for the current clock.
+ *
+ * Measures the fallback loop against SysTick and enables the DWT
+ * cycle counter, if present. Called by timebase_init() and on clock
+ * changes.
+ */
+void delay_calibrate(void);
+
+
+/** Fallback busy loop, 'n' iterations */
 inline __attribute__((always_inline))
-void delay_cycles(uint32_t n)
+void delay_loop(uint32_t n)
 {
-	uint32_t l = n >> 2;
+	if (n == 0) return;
 
 	__asm volatile(
-	"0: mov r0,r0;"
-			"subs %[count], #1;"
+	"0: subs %[count], #1;"
 			"bne 0b;"
-	: [count] "+r"(l)
+	: [count] "+r"(n)
 	);
 }
 
 
+/**
+ * @brief Busy-wait for a number of core cycles.
+ *
+ * Accurate to a few cycles with the DWT counter, independent of flash
+ * wait states and interrupts (time spent in ISRs counts towards the delay).
+ */
+inline __attribute__((always_inline))
+void delay_cycles(uint32_t n)
+{
+	if (delay_use_dwt) {
+		uint32_t start = DWT->CYCCNT;
+		while (DWT->CYCCNT - start < n);
+	} else {
+		delay_loop((n << 4) / delay_loop_cycles_x16);
+	}
+}
+
+
+/** Nanosecond delay, max ~59 ms at 72 MHz. Rounded up to whole cycles. */
 inline __attribute__((always_inline))
 void delay_ns(uint32_t ns)
 {
-	delay_cycles(ns / 24);
+	delay_cycles((ns * delay_cycles_per_us + 999) / 1000);
 }
 
 
@@ -136,7 +217,7 @@ void delay_ns(uint32_t ns)
 inline __attribute__((always_inline))
 void delay_us(uint32_t us)
 {
-	delay_ns(us * 1150);
+	delay_cycles(us * delay_cycles_per_us);
 }
 
 
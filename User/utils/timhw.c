@@ -0,0 +1,133 @@
+#include <common.h>
+#include "timhw.h"
+
+
+/** Enable a timer's peripheral clock */
+bool tim_clock_enable(TIM_TypeDef *tim)
+{
+	if (tim == TIM1) __HAL_RCC_TIM1_CLK_ENABLE();
+	else if (tim == TIM2) __HAL_RCC_TIM2_CLK_ENABLE();
+	else if (tim == TIM3) __HAL_RCC_TIM3_CLK_ENABLE();
+#ifdef TIM4
+	else if (tim == TIM4) __HAL_RCC_TIM4_CLK_ENABLE();
+#endif
+	else return false;
+
+	return true;
+}
+
+
+/** Configure a timer channel pin */
+bool tim_pin_init(TIM_TypeDef *tim, uint8_t channel, uint32_t mode, uint32_t pull)
+{
+	if (channel < 1 || channel > 4) return false;
+
+	GPIO_TypeDef *port;
+	uint16_t pin;
+
+	if (tim == TIM1) {
+		port = GPIOA;
+		pin = (uint16_t) (GPIO_PIN_8 << (channel - 1));
+	} else if (tim == TIM2) {
+		port = GPIOA;
+		pin = (uint16_t) (GPIO_PIN_0 << (channel - 1));
+	} else if (tim == TIM3) {
+		if (channel <= 2) {
+			port = GPIOA;
+			pin = (uint16_t) (GPIO_PIN_6 << (channel - 1));
+		} else {
+			port = GPIOB;
+			pin = (uint16_t) (GPIO_PIN_0 << (channel - 3));
+		}
+	}
+#ifdef TIM4
+	else if (tim == TIM4) {
+		port = GPIOB;
+		pin = (uint16_t) (GPIO_PIN_6 << (channel - 1));
+	}
+#endif
+	else return false;
+
+	if (port == GPIOA) __HAL_RCC_GPIOA_CLK_ENABLE();
+	else __HAL_RCC_GPIOB_CLK_ENABLE();
+
+	GPIO_InitTypeDef gpio;
+	gpio.Pin = pin;
+	gpio.Mode = mode;
+	gpio.Pull = pull;
+	gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_Init(port, &gpio);
+
+	return true;
+}
+
+
+/** Get a timer's input clock */
+uint32_t tim_input_clock(TIM_TypeDef *tim)
+{
+	uint32_t pclk;
+	bool divided;
+
+	if (tim == TIM1) {
+		pclk = HAL_RCC_GetPCLK2Freq();
+		divided = (RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1;
+	} else {
+		pclk = HAL_RCC_GetPCLK1Freq();
+		divided = (RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1;
+	}
+
+	return divided ? pclk * 2 : pclk;
+}
+
+
+/** Find prescaler and period for an update rate */
+bool tim_rate_config(TIM_TypeDef *tim, uint32_t rate, uint16_t *psc, uint16_t *arr)
+{
+	if (rate == 0) return false;
+
+	uint32_t ticks = tim_input_clock(tim) / rate;
+	if (ticks < 2) return false;
+
+	// smallest prescaler, for the best resolution
+	uint32_t div = (ticks - 1) / 65536 + 1;
+	if (div > 65536) return false;
+
+	*psc = (uint16_t) (div - 1);
+	*arr = (uint16_t) (ticks / div - 1);
+	return true;
+}
+
+
+/** Get the DMA1 channel of a timer's update request */
+uint8_t tim_up_dma(TIM_TypeDef *tim)
+{
+	if (tim == TIM1) return 5;
+	if (tim == TIM2) return 2;
+	if (tim == TIM3) return 3;
+#ifdef TIM4
+	if (tim == TIM4) return 7;
+#endif
+	return 0;
+}
+
+
+/** Get the DMA1 channel of a timer's capture/compare request */
+uint8_t tim_cc_dma(TIM_TypeDef *tim, uint8_t channel)
+{
+	static const uint8_t tim1[4] = {2, 3, 6, 4};
+	static const uint8_t tim2[4] = {5, 7, 1, 7};
+	static const uint8_t tim3[4] = {6, 0, 2, 3};
+#ifdef TIM4
+	static const uint8_t tim4[4] = {1, 4, 5, 0};
+#endif
+
+	if (channel < 1 || channel > 4) return 0;
+
+	if (tim == TIM1) return tim1[channel - 1];
+	if (tim == TIM2) return tim2[channel - 1];
+	if (tim == TIM3) return tim3[channel - 1];
+#ifdef TIM4
+	if (tim == TIM4) return tim4[channel - 1];
+#endif
+	return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef MPORK_TIMHW_H
+#define MPORK_TIMHW_H
+
+/**
+ * Timer hardware helpers shared by the timer modules (encoder, ...).
+ *
+ * Channel pins use the default (not remapped) AFIO mapping:
+ *
+ *          CH1   CH2   CH3   CH4
+ *   TIM1   PA8   PA9   PA10  PA11   (PA9, PA10 are USART1)
+ *   TIM2   PA0   PA1   PA2   PA3
+ *   TIM3   PA6   PA7   PB0   PB1
+ *   TIM4   PB6   PB7   PB8   PB9    (medium density parts)
+ *
+ * Timer DMA requests are on DMA1; each channel serves several requests,
+ * so two modules can't use requests sharing a channel at the same time.
+ */
+
+#include <common.h>
+
+/**
+ * @brief Enable a timer's peripheral clock.
+ * @return false if the timer isn't supported
+ */
+bool tim_clock_enable(TIM_TypeDef *tim);
+
+/**
+ * @brief Configure a timer channel pin (also enables the GPIO port clock).
+ * @param channel : 1-4
+ * @param mode    : GPIO_MODE_INPUT or GPIO_MODE_AF_PP
+ * @param pull    : GPIO_NOPULL, GPIO_PULLUP or GPIO_PULLDOWN (inputs)
+ * @return false if the timer or channel isn't supported
+ */
+bool tim_pin_init(TIM_TypeDef *tim, uint8_t channel, uint32_t mode, uint32_t pull);
+
+/**
+ * @brief Get a timer's input clock (before the prescaler).
+ *
+ * That's the APB clock, doubled when the APB prescaler isn't 1.
+ */
+uint32_t tim_input_clock(TIM_TypeDef *tim);
+
+/**
+ * @brief Find prescaler and period for an update rate.
+ * @param rate   : update events per second
+ * @param psc    : output, PSC value
+ * @param arr    : output, ARR value
+ * @return false if the rate is out of range
+ */
+bool tim_rate_config(TIM_TypeDef *tim, uint32_t rate, uint16_t *psc, uint16_t *arr);
+
+/**
+ * @brief Get the DMA1 channel serving a timer's update (TIMx_UP) request.
+ * @return channel number 1-7, 0 if none
+ */
+uint8_t tim_up_dma(TIM_TypeDef *tim);
+
+/**
+ * @brief Get the DMA1 channel serving a timer's capture/compare request (TIMx_CHy).
+ * @param channel : 1-4
+ * @return channel number 1-7, 0 if none (e.g. TIM3_CH2)
+ */
+uint8_t tim_cc_dma(TIM_TypeDef *tim, uint8_t channel);
+
+/** Get a DMA1 channel by number (1-7) */
+static inline DMA_Channel_TypeDef *dma1_channel(uint8_t ch)
+{
+	return (DMA_Channel_TypeDef *) (DMA1_Channel1_BASE + (ch - 1) * (DMA1_Channel2_BASE - DMA1_Channel1_BASE));
+}
+
+/** Get a DMA1 channel's IRQ number */
+static inline IRQn_Type dma1_channel_irq(uint8_t ch)
+{
+	return (IRQn_Type) (DMA1_Channel1_IRQn + ch - 1);
+}
+
+/** DMA1 flag of a channel (ISR, IFCR), e.g. dma1_flag(ch, DMA_ISR_TCIF1) */
+#define dma1_flag(ch, flag1) ((flag1) << (((ch) - 1) * 4))
+
+#endif //MPORK_TIMHW_H
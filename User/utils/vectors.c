@@ -0,0 +1,60 @@
+#include <common.h>
+#include "vectors.h"
+
+/** Flash vector table, from the startup file */
+extern const uint32_t g_pfnVectors[];
+
+/** SRAM copy. VTOR needs the table aligned to its size rounded up to a power of 2. */
+static uint32_t ram_vectors[VECTOR_COUNT] __attribute__((section(".ram_vectors"), aligned(256), used));
+
+_Static_assert(sizeof(ram_vectors) <= 256, "ram_vectors alignment too small");
+
+
+/** Copy the vector table to SRAM and switch to it */
+void vectors_init(void)
+{
+	for (size_t i = 0; i < VECTOR_COUNT; i++) {
+		ram_vectors[i] = g_pfnVectors[i];
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	SCB->VTOR = (uint32_t) ram_vectors;
+	__DSB();
+	__ISB();
+
+	__set_PRIMASK(primask);
+}
+
+
+/** Install an interrupt handler */
+irq_handler_t irq_install(IRQn_Type irq, irq_handler_t handler)
+{
+	if (SCB->VTOR != (uint32_t) ram_vectors) {
+		vectors_init();
+	}
+
+	// vector 0 is the initial SP, exceptions from 1
+	int32_t n = (int32_t) irq + 16;
+	if (n < 1 || n >= VECTOR_COUNT) return NULL;
+
+	irq_handler_t prev = (irq_handler_t) ram_vectors[n];
+	ram_vectors[n] = (uint32_t) handler;
+
+	// make sure the write lands before the IRQ can fire
+	__DSB();
+
+	return prev;
+}
+
+
+/** Get the currently installed handler */
+irq_handler_t irq_get(IRQn_Type irq)
+{
+	int32_t n = (int32_t) irq + 16;
+	if (n < 1 || n >= VECTOR_COUNT) return NULL;
+
+	const uint32_t *table = (const uint32_t *) SCB->VTOR;
+	return (irq_handler_t) table[n];
+}
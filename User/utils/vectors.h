@@ -0,0 +1,42 @@
+#ifndef MPORK_VECTORS_H
+#define MPORK_VECTORS_H
+
+/**
+ * Vector table in SRAM.
+ *
+ * vectors_init() copies the table from flash (g_pfnVectors in the startup
+ * file) to the .ram_vectors section and points SCB->VTOR at it, so vector
+ * fetches don't stall on flash wait states.
+ *
+ * irq_install() then replaces handlers at runtime. A directly installed
+ * handler skips the generated xxx_IRQHandler -> HAL_xxx_IRQHandler ->
+ * callback chain; it must clear the peripheral's pending flags itself.
+ */
+
+#include <common.h>
+
+/** Number of vectors: 16 system exceptions + device IRQs */
+#define VECTOR_COUNT (16 + USBWakeUp_IRQn + 1)
+
+/** Interrupt handler */
+typedef void (*irq_handler_t)(void);
+
+/** Copy the vector table to SRAM and switch to it. Call early, before enabling interrupts of our own. */
+void vectors_init(void);
+
+/**
+ * @brief Install an interrupt handler.
+ *
+ * Calls vectors_init() if the table is still in flash.
+ * Doesn't touch the NVIC enable or priority.
+ *
+ * @param irq     : IRQ number (negative for system exceptions, e.g. SysTick_IRQn)
+ * @param handler : the new handler
+ * @return the previous handler
+ */
+irq_handler_t irq_install(IRQn_Type irq, irq_handler_t handler);
+
+/** Get the currently installed handler */
+irq_handler_t irq_get(IRQn_Type irq);
+
+#endif //MPORK_VECTORS_H
@@ -0,0 +1,158 @@
+#include <common.h>
+#include "waveform.h"
+#include "timhw.h"
+#include "vectors.h"
+#include "clock.h"
+
+struct waveform {
+	TIM_TypeDef *tim;
+	GPIO_TypeDef *port;
+	uint32_t rate;
+	uint8_t dma;        ///< DMA1 channel number
+	volatile bool busy;
+};
+
+static struct waveform waveforms[WAVEFORM_MAX];
+static size_t waveform_count = 0;
+
+static void waveform_dma_isr(void);
+static void waveform_retime(uint32_t hclk);
+
+
+/** Set up a waveform engine */
+waveform_t *waveform_init(const waveform_init_t *init)
+{
+	if (waveform_count >= WAVEFORM_MAX) return NULL;
+
+	uint8_t dma = tim_up_dma(init->tim);
+	if (dma == 0 || !tim_clock_enable(init->tim)) return NULL;
+
+	uint16_t psc, arr;
+	if (!tim_rate_config(init->tim, init->rate, &psc, &arr)) return NULL;
+
+	if (waveform_count == 0) {
+		clock_add_listener(waveform_retime);
+	}
+
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	struct waveform *wf = &waveforms[waveform_count++];
+	wf->tim = init->tim;
+	wf->port = init->port;
+	wf->rate = init->rate;
+	wf->dma = dma;
+	wf->busy = false;
+
+	TIM_TypeDef *tim = wf->tim;
+	tim->CR1 = TIM_CR1_ARPE;
+	tim->PSC = psc;
+	tim->ARR = arr;
+	tim->EGR = TIM_EGR_UG; // load the prescaler
+
+	irq_install(dma1_channel_irq(dma), waveform_dma_isr);
+	HAL_NVIC_SetPriority(dma1_channel_irq(dma), WAVEFORM_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(dma1_channel_irq(dma));
+
+	return wf;
+}
+
+
+/** Start output of a buffer */
+bool waveform_start(waveform_t *wf, const uint32_t *buf, size_t len, bool loop)
+{
+	if (len == 0 || len > 0xFFFF) return false;
+
+	waveform_stop(wf);
+
+	DMA_Channel_TypeDef *ch = dma1_channel(wf->dma);
+	ch->CPAR = (uint32_t) &wf->port->BSRR;
+	ch->CMAR = (uint32_t) buf;
+	ch->CNDTR = len;
+	DMA1->IFCR = dma1_flag(wf->dma, DMA_IFCR_CGIF1);
+
+	// memory to peripheral, 32-bit words, high priority
+	uint32_t ccr = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PL_1;
+	ccr |= loop ? DMA_CCR_CIRC : DMA_CCR_TCIE;
+	ch->CCR = ccr | DMA_CCR_EN;
+
+	wf->busy = true;
+
+	wf->tim->CNT = 0;
+	wf->tim->DIER |= TIM_DIER_UDE;
+	wf->tim->CR1 |= TIM_CR1_CEN;
+
+	return true;
+}
+
+
+/** Stop the output */
+void waveform_stop(waveform_t *wf)
+{
+	wf->tim->CR1 &= ~TIM_CR1_CEN;
+	wf->tim->DIER &= ~TIM_DIER_UDE;
+	dma1_channel(wf->dma)->CCR = 0;
+	wf->busy = false;
+}
+
+
+/** Check if the waveform is running */
+bool waveform_busy(waveform_t *wf)
+{
+	return wf->busy;
+}
+
+
+/** Change the word rate */
+bool waveform_set_rate(waveform_t *wf, uint32_t rate)
+{
+	uint16_t psc, arr;
+	if (!tim_rate_config(wf->tim, rate, &psc, &arr)) return false;
+
+	wf->rate = rate;
+	wf->tim->PSC = psc; // both take effect at the next update
+	wf->tim->ARR = arr;
+
+	return true;
+}
+
+
+/** Fill a buffer with a software PWM pattern */
+void waveform_fill_pwm(uint32_t *buf, size_t len, const uint16_t *pins, const uint16_t *duty, size_t count)
+{
+	for (size_t i = 0; i < len; i++) buf[i] = 0; // no change
+
+	for (size_t c = 0; c < count; c++) {
+		if (duty[c] == 0) {
+			buf[0] |= waveform_word(0, pins[c]);
+		} else {
+			buf[0] |= waveform_word(pins[c], 0);
+			if (duty[c] < len) buf[duty[c]] |= waveform_word(0, pins[c]);
+		}
+	}
+}
+
+
+/** One-shot waveform finished - stop the timer */
+static void waveform_dma_isr(void)
+{
+	for (size_t i = 0; i < waveform_count; i++) {
+		struct waveform *wf = &waveforms[i];
+		// circular waveforms set the flag too, but have no interrupt
+		if (!(dma1_channel(wf->dma)->CCR & DMA_CCR_TCIE)) continue;
+		if (!(DMA1->ISR & dma1_flag(wf->dma, DMA_ISR_TCIF1))) continue;
+
+		DMA1->IFCR = dma1_flag(wf->dma, DMA_IFCR_CGIF1);
+		waveform_stop(wf);
+	}
+}
+
+
+/** Keep the rates after a clock change */
+static void waveform_retime(uint32_t hclk)
+{
+	UNUSED(hclk);
+
+	for (size_t i = 0; i < waveform_count; i++) {
+		waveform_set_rate(&waveforms[i], waveforms[i].rate);
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef MPORK_WAVEFORM_H
+#define MPORK_WAVEFORM_H
+
+/**
+ * GPIO waveform engine.
+ *
+ * A buffer of BSRR words (pins to set in the low half, pins to reset
+ * in the high half) is copied to a port's BSRR by DMA, one word per
+ * timer update event. The pins change with the timer's precision and
+ * no CPU time - good for multi-channel software PWM, stepper pulse
+ * trains or bit-banged protocols, up to about 1 MHz.
+ *
+ * A one-shot waveform stops the timer when done (DMA interrupt);
+ * a circular one repeats until waveform_stop().
+ *
+ * The pins must be configured as outputs. The timer update DMA channel
+ * (see timhw.h) is used while running. The rate is kept across clock
+ * profile changes.
+ */
+
+#include <common.h>
+
+/** Max number of engines (one per timer) */
+#define WAVEFORM_MAX 2
+
+/** DMA interrupt priority (one-shot end only) */
+#define WAVEFORM_IRQ_PRIORITY 3
+
+typedef struct {
+	TIM_TypeDef *tim;     ///< pacing timer, not used for anything else
+	GPIO_TypeDef *port;   ///< output port
+	uint32_t rate;        ///< words per second
+} waveform_init_t;
+
+typedef struct waveform waveform_t;
+
+/** Make a BSRR word */
+static inline uint32_t waveform_word(uint16_t set, uint16_t reset)
+{
+	return set | ((uint32_t) reset << 16);
+}
+
+/**
+ * @brief Set up a waveform engine.
+ * @return the engine, NULL on failure
+ */
+waveform_t *waveform_init(const waveform_init_t *init);
+
+/**
+ * @brief Start output of a buffer. A running waveform is stopped first.
+ *
+ * The buffer is read by DMA while running: it must stay valid, and may
+ * be modified on the fly (e.g. new PWM duties in circular mode).
+ *
+ * @param buf  : BSRR words
+ * @param len  : number of words (max 65535)
+ * @param loop : repeat until stopped
+ * @return success
+ */
+bool waveform_start(waveform_t *wf, const uint32_t *buf, size_t len, bool loop);
+
+/** Stop the output (pins keep their current state) */
+void waveform_stop(waveform_t *wf);
+
+/** Check if the waveform is running */
+bool waveform_busy(waveform_t *wf);
+
+/** Change the word rate (also while running) */
+bool waveform_set_rate(waveform_t *wf, uint32_t rate);
+
+/**
+ * @brief Fill a buffer with a software PWM pattern, for circular output.
+ *
+ * Channel c goes high at word 0 and low at word duty[c];
+ * the PWM frequency is rate / len.
+ *
+ * @param buf   : buffer to fill
+ * @param len   : buffer length, the PWM resolution
+ * @param pins  : pin mask of each channel
+ * @param duty  : high time of each channel (0-len)
+ * @param count : number of channels
+ */
+void waveform_fill_pwm(uint32_t *buf, size_t len, const uint16_t *pins, const uint16_t *duty, size_t count);
+
+#endif //MPORK_WAVEFORM_H
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""
+Decode crash dumps stored in flash by User/utils/crashdump.c.
+
+Read the crash dump page and symbolize it against the firmware ELF:
+
+    crashdump.py --read --elf build/f103-bluepill.elf
+    crashdump.py --elf build/f103-bluepill.elf dump.bin
+
+--read runs `st-flash read` on the crash dump page (see the CRASHDUMP
+region in STM32F103C8Tx_FLASH.ld).
+"""
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+CRASHDUMP_ADDR = 0x0800FC00
+CRASHDUMP_SIZE = 1024
+
+MAGIC = 0xC4A5D00D
+VERSION = 1
+
+STACK_WORDS = 32
+LOG_LINES = 4
+LOG_LEN = 48
+BUILD_ID_LEN = 8
+
+# must match crashdump_t
+HEADER_FMT = '<IHHII%ds8I7I%dI' % (BUILD_ID_LEN, STACK_WORDS)
+RECORD_SIZE = struct.calcsize(HEADER_FMT) + LOG_LINES * LOG_LEN
+SLOT_SIZE = (RECORD_SIZE + 3) & ~3
+CRC_OFFSET = 12
+
+EXCEPTIONS = {3: 'HardFault', 4: 'MemManage', 5: 'BusFault', 6: 'UsageFault'}
+
+CFSR_BITS = {
+    0: 'IACCVIOL', 1: 'DACCVIOL', 3: 'MUNSTKERR', 4: 'MSTKERR', 7: 'MMARVALID',
+    8: 'IBUSERR', 9: 'PRECISERR', 10: 'IMPRECISERR', 11: 'UNSTKERR', 12: 'STKERR', 15: 'BFARVALID',
+    16: 'UNDEFINSTR', 17: 'INVSTATE', 18: 'INVPC', 19: 'NOCP', 24: 'UNALIGNED', 25: 'DIVBYZERO',
+}
+HFSR_BITS = {1: 'VECTTBL', 30: 'FORCED', 31: 'DEBUGEVT'}
+
+
+def bits(value, names):
+    return ' '.join(name for bit, name in sorted(names.items()) if value & (1 << bit))
+
+
+class Record:
+    def __init__(self, raw):
+        f = struct.unpack_from(HEADER_FMT, raw)
+        (self.magic, self.version, self.size, self.crc, self.uptime_ms, self.build_id) = f[:6]
+        self.regs = f[6:14]
+        (self.sp, self.exc_return, self.ipsr, self.cfsr, self.hfsr, self.mmfar, self.bfar) = f[14:21]
+        self.stack = f[21:21 + STACK_WORDS]
+        off = struct.calcsize(HEADER_FMT)
+        self.log = []
+        for i in range(LOG_LINES):
+            line = raw[off + i * LOG_LEN: off + (i + 1) * LOG_LEN].split(b'\0')[0]
+            if line:
+                self.log.append(line.decode('ascii', errors='replace'))
+        self.valid = (self.magic == MAGIC and self.version == VERSION and self.size == RECORD_SIZE
+                      and self.crc == zlib.crc32(raw[CRC_OFFSET:RECORD_SIZE]))
+
+
+def parse(data):
+    """Parse a crash dump page, returns the valid records (oldest first)"""
+    records = []
+    for off in range(0, len(data) - RECORD_SIZE + 1, SLOT_SIZE):
+        rec = Record(data[off:off + RECORD_SIZE])
+        if rec.valid:
+            records.append(rec)
+    return records
+
+
+class Symbolizer:
+    def __init__(self, elf, prefix):
+        self.elf = elf
+        self.prefix = prefix
+
+    def build_id(self):
+        out = subprocess.run([self.prefix + 'readelf', '-n', self.elf],
+                             capture_output=True, text=True).stdout
+        m = re.search(r'Build ID:\s*([0-9a-f]+)', out)
+        return bytes.fromhex(m.group(1)) if m else None
+
+    def lookup(self, addrs):
+        """Map addresses to 'function at file:line', None for non-code"""
+        if not addrs:
+            return {}
+        out = subprocess.run([self.prefix + 'addr2line', '-f', '-C', '-e', self.elf]
+                             + ['0x%x' % a for a in addrs],
+                             capture_output=True, text=True).stdout.splitlines()
+        result = {}
+        for i, a in enumerate(addrs):
+            func, loc = out[2 * i], out[2 * i + 1]
+            result[a] = None if func == '??' else '%s at %s' % (func, os.path.basename(loc))
+        return result
+
+
+def report(rec, index, sym):
+    exc = EXCEPTIONS.get(rec.ipsr, 'exception %d' % rec.ipsr)
+    print('=== Crash %d: %s after %.3f s ===' % (index, exc, rec.uptime_ms / 1000.0))
+
+    line = 'Build ID %s' % rec.build_id.hex()
+    if sym:
+        own = sym.build_id()
+        if own is None:
+            line += ' (ELF has no build ID)'
+        elif own[:BUILD_ID_LEN] == rec.build_id:
+            line += ' (matches ELF)'
+        else:
+            line += ' (DOES NOT MATCH ELF %s - symbols may be wrong)' % own[:BUILD_ID_LEN].hex()
+    print(line)
+
+    names = ['R0', 'R1', 'R2', 'R3', 'R12', 'LR', 'PC', 'PSR']
+    pc, lr = rec.regs[6], rec.regs[5]
+    stack_code = [w & ~1 for w in rec.stack if w & 1 and 0x08000000 <= w < CRASHDUMP_ADDR]
+    symbols = sym.lookup([pc, lr & ~1] + stack_code) if sym else {}
+
+    for name, value in zip(names, rec.regs):
+        extra = ''
+        if name == 'PC':
+            extra = symbols.get(pc) or ''
+        elif name == 'LR':
+            extra = symbols.get(lr & ~1) or ''
+        print('  %-4s 0x%08x  %s' % (name, value, extra))
+    print('  SP   0x%08x' % rec.sp)
+    print('  EXC  0x%08x' % rec.exc_return)
+    print('  CFSR 0x%08x  %s' % (rec.cfsr, bits(rec.cfsr, CFSR_BITS)))
+    print('  HFSR 0x%08x  %s' % (rec.hfsr, bits(rec.hfsr, HFSR_BITS)))
+    if rec.cfsr & (1 << 7):
+        print('  MMFAR 0x%08x' % rec.mmfar)
+    if rec.cfsr & (1 << 15):
+        print('  BFAR  0x%08x' % rec.bfar)
+
+    if sym:
+        print('Possible call chain (from stack):')
+        for a in stack_code:
+            if symbols.get(a):
+                print('  0x%08x  %s' % (a, symbols[a]))
+
+    print('Stack:')
+    for i in range(0, STACK_WORDS, 4):
+        words = ' '.join('%08x' % w for w in rec.stack[i:i + 4])
+        print('  %08x: %s' % (rec.sp + i * 4, words))
+
+    if rec.log:
+        print('Last log lines:')
+        for line in reversed(rec.log):
+            print('  ' + line)
+    print()
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Crash dump decoder')
+    ap.add_argument('dump', nargs='?', help='binary of the crash dump page')
+    ap.add_argument('--read', action='store_true', help='read the page with st-flash')
+    ap.add_argument('--elf', help='firmware ELF for symbols')
+    ap.add_argument('--prefix', default='arm-none-eabi-', help='binutils prefix')
+    args = ap.parse_args()
+
+    if args.read:
+        with tempfile.NamedTemporaryFile(suffix='.bin') as tmp:
+            subprocess.run(['st-flash', 'read', tmp.name, hex(CRASHDUMP_ADDR), str(CRASHDUMP_SIZE)],
+                           check=True)
+            data = open(tmp.name, 'rb').read()
+    elif args.dump:
+        data = open(args.dump, 'rb').read()
+    else:
+        ap.error('give a dump file or --read')
+
+    records = parse(data)
+    if not records:
+        print('No crash dumps stored.')
+        return
+
+    sym = Symbolizer(args.elf, args.prefix) if args.elf else None
+    for i, rec in enumerate(records):
+        report(rec, i, sym)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
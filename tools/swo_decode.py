@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Decoder for the ITM packet stream captured from the SWO pin.
+
+Usage:
+    swo_decode.py capture.bin            # text log + events
+    swo_decode.py -c 1 capture.bin       # only profiling events
+    st-trace ... | swo_decode.py -       # live from stdin
+
+Channel assignment matches User/utils/itm.h:
+    0 - text log, 1 - profiling events, 2 - task switches
+"""
+
+import argparse
+import sys
+
+CH_LOG = 0
+CH_PROFILE = 1
+CH_TASK = 2
+
+CHANNEL_NAMES = {
+    CH_LOG: 'log',
+    CH_PROFILE: 'prof',
+    CH_TASK: 'task',
+}
+
+
+class Packet:
+    """One decoded ITM packet"""
+
+    SWIT = 'swit'            # software stimulus (our data)
+    HW = 'hw'                # DWT hardware source
+    SYNC = 'sync'
+    OVERFLOW = 'overflow'
+    TIMESTAMP = 'timestamp'
+    EXTENSION = 'extension'
+
+    def __init__(self, kind, port=0, data=b'', value=0):
+        self.kind = kind
+        self.port = port
+        self.data = data
+        self.value = value
+
+    def __repr__(self):
+        if self.kind in (Packet.SWIT, Packet.HW):
+            return '<%s %d %s>' % (self.kind, self.port, self.data.hex())
+        return '<%s %d>' % (self.kind, self.value)
+
+
+def _read_continued(data, i):
+    """Read a value stored in 7-bit groups with a continuation bit. Returns (value, next index)"""
+    value = 0
+    shift = 0
+    while i < len(data):
+        b = data[i]
+        i += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    return value, i
+
+
+def decode(data):
+    """
+    Decode a recorded SWO byte stream into packets.
+    Truncated packets at the end of the buffer are ignored.
+    """
+    i = 0
+    n = len(data)
+    zeros = 0
+
+    while i < n:
+        h = data[i]
+        i += 1
+
+        # Synchronization: at least 5 zero bytes, then 0x80
+        if h == 0x00:
+            zeros += 1
+            continue
+        if zeros:
+            if zeros >= 5 and h == 0x80:
+                zeros = 0
+                yield Packet(Packet.SYNC)
+                continue
+            zeros = 0
+
+        if h == 0x70:
+            yield Packet(Packet.OVERFLOW)
+            continue
+
+        size_code = h & 0x03
+        if size_code:
+            # Source packet, payload of 1, 2 or 4 bytes
+            size = (1, 2, 4)[size_code - 1]
+            if i + size > n:
+                return
+            payload = bytes(data[i:i + size])
+            i += size
+            kind = Packet.HW if h & 0x04 else Packet.SWIT
+            yield Packet(kind, port=h >> 3, data=payload,
+                         value=int.from_bytes(payload, 'little'))
+            continue
+
+        if h & 0x0F == 0x00:
+            # Local timestamp
+            if h & 0x80:
+                value, i = _read_continued(data, i)
+            else:
+                value = (h >> 4) & 0x07
+            yield Packet(Packet.TIMESTAMP, value=value)
+            continue
+
+        if h in (0x94, 0xB4):
+            # Global timestamp
+            value, i = _read_continued(data, i)
+            yield Packet(Packet.TIMESTAMP, value=value)
+            continue
+
+        if h & 0x0B == 0x08:
+            # Extension (stimulus port page)
+            value = (h >> 4) & 0x07
+            if h & 0x80:
+                more, i = _read_continued(data, i)
+                value |= more << 3
+            yield Packet(Packet.EXTENSION, value=value)
+            continue
+
+        # Reserved header - skip and resynchronize on the next byte
+
+
+def render(packets, channels=None, out=sys.stdout):
+    """Print the log channel as text, other channels as one event per line"""
+    at_line_start = True
+
+    for p in packets:
+        if p.kind == Packet.OVERFLOW:
+            if not at_line_start:
+                out.write('\n')
+            out.write('<ITM overflow - data lost>\n')
+            at_line_start = True
+            continue
+
+        if p.kind != Packet.SWIT:
+            continue
+        if channels is not None and p.port not in channels:
+            continue
+
+        if p.port == CH_LOG:
+            text = p.data.decode('ascii', errors='replace')
+            out.write(text)
+            at_line_start = text.endswith('\n')
+        else:
+            if not at_line_start:
+                out.write('\n')
+            name = CHANNEL_NAMES.get(p.port, 'ch%d' % p.port)
+            out.write('[%s] 0x%08x (%d)\n' % (name, p.value, p.value))
+            at_line_start = True
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode an ITM/SWO capture')
+    ap.add_argument('file', help='capture file, "-" for stdin')
+    ap.add_argument('-c', '--channel', type=int, action='append',
+                    help='show only this stimulus port (repeatable)')
+    ap.add_argument('--packets', action='store_true',
+                    help='dump all packets instead of rendering')
+    args = ap.parse_args()
+
+    if args.file == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+
+    packets = decode(data)
+
+    if args.packets:
+        for p in packets:
+            print(p)
+    else:
+        render(packets, set(args.channel) if args.channel else None)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+Decode and replay a telemetry capture (or a live serial port).
+
+    telem_replay.py capture.bin               # print all records
+    telem_replay.py --realtime capture.bin    # replay at the original pace
+    telem_replay.py --csv out.csv capture.bin # export sample records
+    telem_replay.py --port /dev/ttyUSB0       # live, needs pyserial
+    telem_replay.py --port /dev/ttyUSB0 --save capture.bin
+"""
+
+import argparse
+import csv
+import sys
+import time
+
+from telemetry import TelemetryDecoder, CH_TEXT, CH_SAMPLE
+
+
+def read_file(path, chunk=4096):
+    with open(path, 'rb') as f:
+        while True:
+            data = f.read(chunk)
+            if not data:
+                return
+            yield data
+
+
+def read_port(port, baud):
+    import serial
+    with serial.Serial(port, baud, timeout=0.1) as ser:
+        while True:
+            data = ser.read(4096)
+            if data:
+                yield data
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Telemetry decoder / replay tool')
+    ap.add_argument('file', nargs='?', help='capture file')
+    ap.add_argument('--port', help='serial port to read live')
+    ap.add_argument('--baud', type=int, default=115200)
+    ap.add_argument('--save', help='save the raw stream to a file (with --port)')
+    ap.add_argument('--realtime', action='store_true', help='replay at the recorded pace')
+    ap.add_argument('--csv', help='write sample records to a CSV file')
+    ap.add_argument('--text-only', action='store_true', help='print only the text log')
+    args = ap.parse_args()
+
+    if args.port:
+        source = read_port(args.port, args.baud)
+    elif args.file:
+        source = read_file(args.file)
+    else:
+        ap.error('give a capture file or --port')
+
+    save = open(args.save, 'wb') if args.save else None
+    csv_out = csv.writer(open(args.csv, 'w', newline='')) if args.csv else None
+
+    dec = TelemetryDecoder()
+    t_start = None
+    wall_start = time.monotonic()
+
+    try:
+        for data in source:
+            if save:
+                save.write(data)
+
+            for rec in dec.feed(data):
+                if args.realtime:
+                    if t_start is None:
+                        t_start = rec.time_ms
+                    delay = (rec.time_ms - t_start) / 1000.0 - (time.monotonic() - wall_start)
+                    if delay > 0:
+                        time.sleep(delay)
+
+                if csv_out and rec.channel == CH_SAMPLE and rec.parsed:
+                    csv_out.writerow([rec.time_ms, rec.id] + rec.values)
+
+                if rec.channel == CH_TEXT:
+                    sys.stdout.write(rec.text)
+                elif not args.text_only:
+                    print(rec)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if save:
+            save.close()
+
+    print('\n%d frames, %d lost, %d invalid' % (dec.frames, dec.lost_frames, dec.bad_frames),
+          file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,143 @@
+"""
+Host-side decoder for the binary telemetry stream (User/utils/telemetry.h).
+
+    dec = TelemetryDecoder()
+    for rec in dec.feed(data):
+        print(rec)
+
+Frames are COBS-encoded and terminated by 0x00. Bytes that don't form
+a valid frame (e.g. plain text printed before framing was enabled)
+are counted in `dec.bad_frames` and skipped.
+"""
+
+import struct
+
+CH_TEXT = 0
+CH_COUNTER = 1
+CH_SAMPLE = 2
+CH_EVENT = 3
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE"""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    """Decode one COBS block (without the delimiter). Raises ValueError if malformed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError('malformed COBS block')
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Record:
+    """A decoded telemetry record"""
+
+    def __init__(self, channel, seq, time_ms, payload):
+        self.channel = channel
+        self.seq = seq
+        self.time_ms = time_ms  # extended to 32 bits by the decoder
+        self.payload = payload
+
+        self.text = None
+        self.id = None
+        self.value = None
+        self.values = None
+        self.code = None
+        self.arg = None
+        self.parsed = True  # False if the payload doesn't match the channel's layout
+
+        if channel == CH_TEXT:
+            self.text = payload.decode('ascii', errors='replace')
+        elif channel == CH_COUNTER and len(payload) == 5:
+            self.id, self.value = struct.unpack('<BI', payload)
+        elif channel == CH_SAMPLE and len(payload) >= 1 and len(payload) % 2 == 1:
+            self.id = payload[0]
+            self.values = list(struct.unpack('<%dh' % ((len(payload) - 1) // 2), payload[1:]))
+        elif channel == CH_EVENT and len(payload) == 6:
+            self.code, self.arg = struct.unpack('<HI', payload)
+        elif channel in (CH_COUNTER, CH_SAMPLE, CH_EVENT):
+            self.parsed = False
+
+    def __repr__(self):
+        t = '%8.3f' % (self.time_ms / 1000.0)
+        if not self.parsed:
+            return '%s ch%d    %s (bad length)' % (t, self.channel, self.payload.hex())
+        if self.channel == CH_TEXT:
+            return '%s text    %r' % (t, self.text)
+        if self.channel == CH_COUNTER:
+            return '%s counter #%d = %d' % (t, self.id, self.value)
+        if self.channel == CH_SAMPLE:
+            return '%s sample  #%d %s' % (t, self.id, self.values)
+        if self.channel == CH_EVENT:
+            return '%s event   %d (arg %d)' % (t, self.code, self.arg)
+        return '%s ch%d    %s' % (t, self.channel, self.payload.hex())
+
+
+class TelemetryDecoder:
+    """Incremental stream decoder"""
+
+    def __init__(self):
+        self._buf = bytearray()
+        self._last_seq = None
+        self._time_hi = 0
+        self._last_time = None
+        self.frames = 0
+        self.bad_frames = 0
+        self.lost_frames = 0
+
+    def _extend_time(self, t16):
+        # the firmware only sends the low 16 bits of the ms counter
+        if self._last_time is not None and t16 < self._last_time:
+            self._time_hi += 0x10000
+        self._last_time = t16
+        return self._time_hi + t16
+
+    def decode_frame(self, block):
+        """Decode one frame (COBS block without the delimiter). Returns a Record or None."""
+        try:
+            frame = cobs_decode(block)
+        except ValueError:
+            self.bad_frames += 1
+            return None
+
+        if len(frame) < 6 or crc16_ccitt(frame[:-2]) != struct.unpack('<H', frame[-2:])[0]:
+            self.bad_frames += 1
+            return None
+
+        channel, seq, t16 = struct.unpack('<BBH', frame[:4])
+
+        if self._last_seq is not None:
+            self.lost_frames += (seq - self._last_seq - 1) & 0xFF
+        self._last_seq = seq
+        self.frames += 1
+
+        return Record(channel, seq, self._extend_time(t16), frame[4:-2])
+
+    def feed(self, data):
+        """Feed received bytes, yields complete records"""
+        self._buf += data
+        while True:
+            end = self._buf.find(b'\x00')
+            if end < 0:
+                return
+            block = bytes(self._buf[:end])
+            del self._buf[:end + 1]
+            if not block:
+                continue
+            rec = self.decode_frame(block)
+            if rec is not None:
+                yield rec
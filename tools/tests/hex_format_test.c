@@ -0,0 +1,50 @@
+// Host test for hex_format() (User/utils/hex.c), run by test_host_c.py
+
+#include <stdio.h>
+#include <string.h>
+#include "utils/hex.h"
+
+#define GUARD 0x5A
+
+int main(void)
+{
+	static const uint8_t data[4] = {0x01, 0xab, 0x7f, 0xff};
+	static const char full[] = "01 ab 7f ff";
+	int failed = 0;
+
+	for (size_t cap = 1; cap <= 8; cap++) {
+		char buf[16];
+		memset(buf, GUARD, sizeof(buf));
+
+		size_t n = hex_format(buf, cap, data, sizeof(data));
+
+		// whole bytes only: "01" needs 3, "01 ab" 6, "01 ab 7f" 9
+		size_t want = (cap >= 9) ? 8 : (cap >= 6) ? 5 : (cap >= 3) ? 2 : 0;
+
+		if (n != want || n >= cap || buf[n] != 0 || memcmp(buf, full, n) != 0) {
+			printf("cap %zu: got %zu \"%.*s\", want %zu\n", cap, n, (int) n, buf, want);
+			failed = 1;
+		}
+
+		for (size_t i = cap; i < sizeof(buf); i++) {
+			if ((uint8_t) buf[i] != GUARD) {
+				printf("cap %zu: wrote past the buffer at %zu\n", cap, i);
+				failed = 1;
+				break;
+			}
+		}
+	}
+
+	// exact fit and cap 0
+	char buf[12];
+	if (hex_format(buf, sizeof(buf), data, sizeof(data)) != 11 || strcmp(buf, full) != 0) {
+		printf("full: got \"%s\"\n", buf);
+		failed = 1;
+	}
+	if (hex_format(buf, 0, data, sizeof(data)) != 0) {
+		printf("cap 0 wrote\n");
+		failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""
+Builds and runs the host C tests (*_test.c) against the firmware sources
+that don't depend on the HAL.
+
+Run from the repository root:
+    python3 -m unittest discover tools/tests
+"""
+
+import os
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(HERE, '..', '..'))
+
+# test source -> firmware sources it links
+TESTS = {
+    'hex_format_test.c': ['User/utils/hex.c'],
+}
+
+CC = os.environ.get('CC', 'cc')
+
+
+@unittest.skipIf(shutil.which(CC) is None, 'no host C compiler')
+class HostCTest(unittest.TestCase):
+
+    def run_c_test(self, test, sources):
+        with tempfile.TemporaryDirectory() as tmp:
+            exe = os.path.join(tmp, 'test')
+            cmd = [CC, '-std=gnu99', '-Wall', '-Wextra', '-Werror', '-fsanitize=address',
+                   '-I', os.path.join(ROOT, 'User'),
+                   os.path.join(HERE, test)] + [os.path.join(ROOT, s) for s in sources] + ['-o', exe]
+            subprocess.run(cmd, check=True)
+            res = subprocess.run([exe], capture_output=True, text=True)
+            self.assertEqual(res.returncode, 0, res.stdout + res.stderr)
+
+    def test_hex_format(self):
+        self.run_c_test('hex_format_test.c', TESTS['hex_format_test.c'])
+
+
+if __name__ == '__main__':
+    unittest.main()
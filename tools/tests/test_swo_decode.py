@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Host tests for tools/swo_decode.py.
+
+Run from the repository root:
+    python3 -m unittest discover tools/tests
+"""
+
+import io
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+import swo_decode as swo
+
+
+def swit(port, payload):
+    """Software stimulus packet, as the ITM emits for a write of len(payload) bytes"""
+    size_code = {1: 1, 2: 2, 4: 3}[len(payload)]
+    return bytes([(port << 3) | size_code]) + payload
+
+
+def log_write(text):
+    """Packets for itm_write(ITM_CH_LOG, ...): full words, then single bytes"""
+    data = text.encode('ascii')
+    out = b''
+    n = len(data) - len(data) % 4
+    for i in range(0, n, 4):
+        out += swit(swo.CH_LOG, data[i:i + 4])
+    for i in range(n, len(data)):
+        out += swit(swo.CH_LOG, data[i:i + 1])
+    return out
+
+
+# A session: sync, a log line, a profiling event, a timestamp, an overflow, more log
+SAMPLE = (
+    b'\x00' * 5 + b'\x80'
+    + log_write('boot ok\r\n')
+    + swit(swo.CH_PROFILE, (0x12345678).to_bytes(4, 'little'))
+    + b'\x30'                    # local timestamp, value 3
+    + b'\x70'                    # overflow
+    + log_write('tick\r\n')
+    + swit(swo.CH_TASK, b'\x05\x01')[:2]   # truncated at the end of the capture
+)
+
+
+class DecodeTest(unittest.TestCase):
+
+    def test_packet_kinds(self):
+        kinds = [p.kind for p in swo.decode(SAMPLE)]
+        self.assertEqual(kinds[0], swo.Packet.SYNC)
+        self.assertIn(swo.Packet.TIMESTAMP, kinds)
+        self.assertIn(swo.Packet.OVERFLOW, kinds)
+        # the truncated task packet is dropped
+        self.assertEqual(kinds[-1], swo.Packet.SWIT)
+
+    def test_values(self):
+        packets = list(swo.decode(SAMPLE))
+        prof = [p for p in packets if p.kind == swo.Packet.SWIT and p.port == swo.CH_PROFILE]
+        self.assertEqual(len(prof), 1)
+        self.assertEqual(prof[0].value, 0x12345678)
+
+        ts = [p for p in packets if p.kind == swo.Packet.TIMESTAMP]
+        self.assertEqual(ts[0].value, 3)
+
+    def test_continued_timestamp(self):
+        # 0xC0: local timestamp with continuation, value 0x81 0x01 = 129
+        packets = list(swo.decode(b'\xc0\x81\x01'))
+        self.assertEqual(packets[0].kind, swo.Packet.TIMESTAMP)
+        self.assertEqual(packets[0].value, 129)
+
+    def test_render(self):
+        out = io.StringIO()
+        swo.render(swo.decode(SAMPLE), out=out)
+        self.assertEqual(out.getvalue(),
+                         'boot ok\r\n'
+                         '[prof] 0x12345678 (305419896)\n'
+                         '<ITM overflow - data lost>\n'
+                         'tick\r\n')
+
+    def test_render_channel_filter(self):
+        out = io.StringIO()
+        swo.render(swo.decode(SAMPLE), channels={swo.CH_PROFILE}, out=out)
+        self.assertEqual(out.getvalue(),
+                         '[prof] 0x12345678 (305419896)\n'
+                         '<ITM overflow - data lost>\n')
+
+
+if __name__ == '__main__':
+    unittest.main()
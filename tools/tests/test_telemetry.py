@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Host tests for tools/telemetry.py.
+
+Run from the repository root:
+    python3 -m unittest discover tools/tests
+"""
+
+import os
+import struct
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+import telemetry as tm
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for b in data:
+        if b == 0:
+            out += bytes([len(block) + 1]) + block
+            block = bytearray()
+        else:
+            block.append(b)
+            if len(block) == 254:
+                out += bytes([255]) + block
+                block = bytearray()
+    out += bytes([len(block) + 1]) + block
+    return bytes(out)
+
+
+def frame(channel, seq, t16, payload):
+    """A frame as telem_send() builds it, with the delimiter"""
+    body = struct.pack('<BBH', channel, seq, t16) + payload
+    body += struct.pack('<H', tm.crc16_ccitt(body))
+    return cobs_encode(body) + b'\x00'
+
+
+class RecordTest(unittest.TestCase):
+
+    def decode(self, *frames):
+        return list(tm.TelemetryDecoder().feed(b''.join(frames)))
+
+    def test_valid_records(self):
+        recs = self.decode(
+            frame(tm.CH_COUNTER, 0, 10, struct.pack('<BI', 3, 1234)),
+            frame(tm.CH_SAMPLE, 1, 11, struct.pack('<Bhh', 2, -5, 7)),
+            frame(tm.CH_EVENT, 2, 12, struct.pack('<HI', 9, 42)),
+        )
+        self.assertEqual([r.parsed for r in recs], [True, True, True])
+        self.assertEqual((recs[0].id, recs[0].value), (3, 1234))
+        self.assertEqual(recs[1].values, [-5, 7])
+        self.assertEqual((recs[2].code, recs[2].arg), (9, 42))
+        self.assertIn('counter #3 = 1234', repr(recs[0]))
+
+    def test_bad_payload_length(self):
+        # valid CRC, payload too short for the channel - must print as raw hex
+        recs = self.decode(
+            frame(tm.CH_COUNTER, 0, 0, b'\x01\x02'),
+            frame(tm.CH_SAMPLE, 1, 0, b'\x01\x02'),
+            frame(tm.CH_EVENT, 2, 0, b''),
+        )
+        self.assertEqual(len(recs), 3)
+        for r in recs:
+            self.assertFalse(r.parsed)
+            self.assertIn('bad length', repr(r))
+
+    def test_unknown_channel(self):
+        recs = self.decode(frame(7, 0, 0, b'\xab'))
+        self.assertTrue(recs[0].parsed)
+        self.assertIn('ch7', repr(recs[0]))
+        self.assertIn('ab', repr(recs[0]))
+
+    def test_corrupt_frame(self):
+        dec = tm.TelemetryDecoder()
+        bad = bytearray(frame(tm.CH_EVENT, 0, 0, struct.pack('<HI', 1, 2)))
+        bad[3] ^= 0x40  # stays non-zero, so the frame isn't split
+        self.assertEqual(list(dec.feed(bytes(bad))), [])
+        self.assertEqual(dec.bad_frames, 1)
+
+
+if __name__ == '__main__':
+    unittest.main()